@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.hpp"
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -27,6 +28,34 @@ public:
         size_t original_size
     ) = 0;
     
+    // 压缩并追加到 output 末尾 (不经过临时缓冲区)
+    // 返回: 追加的字节数，0 表示失败 (output 不变)
+    virtual size_t compress_append(
+        const uint8_t* data,
+        size_t size,
+        std::vector<uint8_t>& output
+    ) {
+        auto compressed = compress(data, size);
+        output.insert(output.end(), compressed.begin(), compressed.end());
+        return compressed.size();
+    }
+    
+    // 解压到调用方提供的 original_size 字节缓冲区 (可复用，不分配)
+    // 返回: 解压结果恰好为 original_size 字节时为 true
+    virtual bool decompress_to(
+        const uint8_t* data,
+        size_t size,
+        uint8_t* output,
+        size_t original_size
+    ) {
+        auto decompressed = decompress(data, size, original_size);
+        if (decompressed.size() != original_size) {
+            return false;
+        }
+        std::copy(decompressed.begin(), decompressed.end(), output);
+        return true;
+    }
+    
     // 设置压缩级别
     virtual void set_level(int level) { level_ = level; }
     int level() const { return level_; }
@@ -56,6 +85,19 @@ public:
         size_t original_size
     ) override;
     
+    size_t compress_append(
+        const uint8_t* data,
+        size_t size,
+        std::vector<uint8_t>& output
+    ) override;
+    
+    bool decompress_to(
+        const uint8_t* data,
+        size_t size,
+        uint8_t* output,
+        size_t original_size
+    ) override;
+    
     const char* name() const override { return "LZ4"; }
     
     // LZ4 特有: 获取压缩后最大大小
@@ -64,9 +106,10 @@ public:
 
 // ============== 压缩器工厂 ==============
 
-enum class CompressionType {
-    None,
-    LZ4,
+// 数值写入补丁文件 (v3 块内各流的编码)，不可更改
+enum class CompressionType : uint8_t {
+    None = 0,
+    LZ4 = 1,
 };
 
 std::unique_ptr<Compressor> create_compressor(
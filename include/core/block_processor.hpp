@@ -1,7 +1,10 @@
 #pragma once
 
 #include "core/operations.hpp"
+#include "core/patch_format.hpp"
+#include "core/chunker.hpp"
 #include "core/matcher.hpp"
+#include "core/suffix_matcher.hpp"
 #include "io/mmap_file.hpp"
 #include "utils/thread_pool.hpp"
 #include "compress/compressor.hpp"
@@ -22,30 +25,81 @@ struct BlockResult {
 
 class BlockProcessor {
 public:
-    BlockProcessor(uint32_t block_size, int compression_level = 1);
+    // lazy_lookahead: 惰性匹配向后检查的位置数，0 表示贪心地接受第一个匹配
+    // self_copy: 未匹配的新数据先在本块已输出的部分中查找重复，找到时输出 COPY_NEW
+    // delta_add: COPY 之后沿同一对齐关系近似扩展，相同字节占多数的区间输出 ADD
+    BlockProcessor(uint32_t block_size, int compression_level = 1, uint32_t lazy_lookahead = 0,
+                   bool self_copy = false, bool delta_add = false);
     ~BlockProcessor();
     
     // 处理单个块 (可并行) - 使用全局索引
+    // anchors: 块内已确定的整块匹配 (偏移相对块起点)，只在其间的空隙做细粒度匹配
     BlockResult process_block(
         uint32_t block_index,
         const byte* old_data, size_t old_size,
         const byte* new_data, size_t new_size,
-        const BlockMatcher* global_matcher = nullptr
+        const BlockMatcher* global_matcher = nullptr,
+        const std::vector<ChunkAnchor>& anchors = {}
+    );
+    
+    // 处理单个块 - 使用后缀数组 (最大压缩模式)
+    BlockResult process_block(
+        uint32_t block_index,
+        const byte* old_data, size_t old_size,
+        const byte* new_data, size_t new_size,
+        const SuffixMatcher& suffix_matcher,
+        const std::vector<ChunkAnchor>& anchors = {}
     );
     
     // 从块数据重建文件
+    // zero_fills 非空时记录由 FILL 0 写出的区间 (相对块起点)，供输出时留作空洞
+    // format_version: 补丁文件头中的版本，决定操作流的编码
+    // output_zeroed: output 事先已全部为零 (如新建的文件映射)，FILL 0 不再写入，不产生脏页
     bool reconstruct_block(
         uint32_t block_index,
         const byte* old_data, size_t old_size,
-        const std::vector<uint8_t>& compressed_data,
+        const uint8_t* compressed_data, size_t compressed_size,
         uint32_t original_size,  // 解压后的原始大小
-        byte* output, size_t output_size
+        byte* output, size_t output_size,
+        std::vector<ByteRange>* zero_fills = nullptr,
+        uint16_t format_version = PatchHeader::VERSION,
+        bool output_zeroed = false
     );
+    
+    bool reconstruct_block(
+        uint32_t block_index,
+        const byte* old_data, size_t old_size,
+        const std::vector<uint8_t>& compressed_data,
+        uint32_t original_size,
+        byte* output, size_t output_size,
+        std::vector<ByteRange>* zero_fills = nullptr,
+        uint16_t format_version = PatchHeader::VERSION,
+        bool output_zeroed = false
+    ) {
+        return reconstruct_block(block_index, old_data, old_size, compressed_data.data(), compressed_data.size(),
+                                 original_size, output, output_size, zero_fills, format_version, output_zeroed);
+    }
 
 private:
+    // 生成操作、序列化并压缩，Cursor 为 MatchCursor 或 SuffixCursor
+    template <typename Cursor>
+    BlockResult encode_block(
+        uint32_t block_index,
+        const byte* old_data, size_t old_size,
+        const byte* new_data, size_t new_size,
+        Cursor& cursor,
+        size_t min_match,       // 匹配器的最短匹配长度，COPY / COPY_NEW 的取舍按它判断
+        const std::vector<ChunkAnchor>& anchors
+    );
+    
     uint32_t block_size_;
     int compression_level_;
-    std::unique_ptr<Compressor> compressor_;
+    uint32_t lazy_lookahead_;
+    bool self_copy_;
+    bool delta_add_;
+    std::unique_ptr<Compressor> compressor_;           // 整个操作流 (v1 / v2) 或 literals 流
+    std::unique_ptr<Compressor> control_compressor_;   // v3 control 流
+    std::unique_ptr<Compressor> diff_compressor_;      // v3 diffs 流
 };
 
 } // namespace bindiff
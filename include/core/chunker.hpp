@@ -0,0 +1,56 @@
+#pragma once
+
+#include "core/matcher.hpp"
+#include "types.hpp"
+#include <vector>
+
+namespace bindiff {
+
+// ============== 内容定义分块 (FastCDC) ==============
+
+// 分块边界只取决于附近的内容，数据整体平移后仍能切出相同的块
+struct ChunkerParams {
+    uint32_t min_size = 4 * 1024;
+    uint32_t avg_size = 16 * 1024;   // 须为 2 的幂
+    uint32_t max_size = 64 * 1024;
+};
+
+struct Chunk {
+    uint64_t offset;
+    uint32_t length;
+    uint64_t fingerprint;   // 内容的 64 位指纹，相同时仍需逐字节确认
+};
+
+// 按 FastCDC (归一化分块) 切分数据并计算每块指纹
+std::vector<Chunk> chunk_data(const byte* data, size_t size, const ChunkerParams& params = {});
+
+// 64 位内容指纹
+uint64_t chunk_fingerprint(const byte* data, size_t size);
+
+// ============== 整块匹配 ==============
+
+// 新文件 [new_offset, new_offset + length) 与旧文件 old_offset 处内容完全相同
+struct ChunkAnchor {
+    uint64_t new_offset;
+    uint64_t old_offset;
+    uint64_t length;
+};
+
+// 对旧、新文件分块，按指纹匹配整块 (逐字节确认)，返回按 new_offset 排序的锚点
+// 新旧偏移都连续的相邻块合并为一个锚点
+std::vector<ChunkAnchor> match_chunks(
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    const ChunkerParams& params = {}
+);
+
+// 锚点覆盖的旧文件区间 (用于跳过细粒度索引)
+std::vector<ByteRange> anchor_old_ranges(const std::vector<ChunkAnchor>& anchors);
+
+// 取出与新文件 [begin, end) 相交的锚点，裁剪并转换为相对 begin 的偏移
+std::vector<ChunkAnchor> anchors_in_range(
+    const std::vector<ChunkAnchor>& anchors,
+    uint64_t begin, uint64_t end
+);
+
+} // namespace bindiff
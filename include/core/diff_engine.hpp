@@ -1,7 +1,9 @@
 #pragma once
 
-#include "core/operations.hpp"
+#include "core/block_processor.hpp"
+#include "core/chunker.hpp"
 #include "core/matcher.hpp"
+#include "core/suffix_matcher.hpp"
 #include "io/mmap_file.hpp"
 #include "utils/thread_pool.hpp"
 #include "compress/compressor.hpp"
@@ -10,43 +12,10 @@
 
 namespace bindiff {
 
-// ============== 分块处理器 ==============
+// ============== 压缩等级 ==============
 
-struct BlockResult {
-    uint32_t block_index;
-    std::vector<uint8_t> data;  // 压缩后的数据
-    uint32_t original_size = 0; // 压缩前的序列化数据大小
-    bool success = false;
-    std::string error;
-};
-
-class BlockProcessor {
-public:
-    BlockProcessor(uint32_t block_size, int compression_level = 1);
-    ~BlockProcessor();
-    
-    // 处理单个块 (可并行) - 使用全局索引
-    BlockResult process_block(
-        uint32_t block_index,
-        const byte* old_data, size_t old_size,
-        const byte* new_data, size_t new_size,
-        const BlockMatcher* global_matcher = nullptr  // 新增：全局索引
-    );
-    
-    // 从块数据重建文件
-    bool reconstruct_block(
-        uint32_t block_index,
-        const byte* old_data, size_t old_size,
-        const std::vector<uint8_t>& compressed_data,
-        uint32_t original_size,
-        byte* output, size_t output_size
-    );
-
-private:
-    uint32_t block_size_;
-    int compression_level_;
-    std::unique_ptr<Compressor> compressor_;
-};
+// options.effort 为 1-9 时按预设填充 matcher、compression_level 与 lazy_lookahead，否则原样返回
+DiffOptions resolve_effort(const DiffOptions& options);
 
 // ============== 差分引擎 ==============
 
@@ -67,6 +36,7 @@ private:
     std::vector<BlockResult> process_all_blocks(
         MMapFile& old_file,
         MMapFile& new_file,
+        IndexBuilder* new_index,    // 非空时顺带收集每块的新文件索引条目
         ProgressCallback* callback
     );
     bool write_patch_file(
@@ -75,13 +45,16 @@ private:
         const MMapFile& new_file,
         const std::vector<BlockResult>& blocks,
         const std::array<uint8_t, 32>& old_hash,
-        const std::array<uint8_t, 32>& new_hash
+        const std::array<uint8_t, 32>& new_hash,
+        std::string& error
     );
     
     DiffOptions options_;
     std::unique_ptr<ThreadPool> thread_pool_;
     std::unique_ptr<BlockProcessor> block_processor_;
     std::unique_ptr<BlockMatcher> global_matcher_;  // 新增：全局匹配器
+    std::unique_ptr<SuffixMatcher> suffix_matcher_; // 后缀数组模式下替代 global_matcher_
+    std::vector<ChunkAnchor> anchors_;              // 整块预匹配结果 (按新文件偏移排序)
 };
 
 } // namespace bindiff
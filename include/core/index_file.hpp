@@ -0,0 +1,67 @@
+#pragma once
+
+#include "core/matcher.hpp"
+#include "types.hpp"
+#include <array>
+#include <string>
+
+namespace bindiff {
+
+// ============== 索引文件 (.bdi) ==============
+
+// 预先构建的旧文件哈希索引，加载时直接映射使用，不做拷贝
+// 布局: [IndexFileHeader] [bucket_starts] [offsets_lo] [tags] [offsets_hi (仅旧文件 >= 4GB)]
+// 各数组起点按 64 字节对齐
+
+#pragma pack(push, 1)
+
+struct IndexFileHeader {
+    char     magic[4];          // 4 bytes  - "UEBI"
+    uint16_t version;           // 2 bytes  - 格式版本 (2)
+    uint16_t hash_kind;         // 2 bytes  - 索引哈希: 0 = Buzhash, 1 = Rabin-Karp
+    uint64_t old_size;          // 8 bytes  - 旧文件大小
+    int64_t  old_mtime;         // 8 bytes  - 旧文件修改时间 (纳秒)，加载时快速校验
+    uint8_t  old_sha256[32];    // 32 bytes - 旧文件 SHA256 (FLAG_HAS_SHA256 时有效)
+    uint32_t min_match;         // 4 bytes  - 哈希窗口长度
+    uint32_t step;              // 4 bytes  - 固定采样步长 (winnowing 时为 1)
+    uint32_t winnow;            // 4 bytes  - winnowing 窗口，0 表示固定步长
+    uint32_t flags;             // 4 bytes  - FLAG_WIDE_OFFSETS | FLAG_HAS_SHA256
+    uint64_t num_buckets;       // 8 bytes
+    uint64_t num_entries;       // 8 bytes
+    uint8_t  reserved[40];      // 40 bytes - 保留
+    // 总计: 128 bytes
+
+    static constexpr size_t SIZE = 128;
+    static constexpr const char* MAGIC = "UEBI";
+    static constexpr uint16_t VERSION = 2;
+    static constexpr uint32_t FLAG_WIDE_OFFSETS = 1;
+    static constexpr uint32_t FLAG_HAS_SHA256 = 2;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(IndexFileHeader) == IndexFileHeader::SIZE, "IndexFileHeader must be 128 bytes");
+
+// 把 matcher 的索引写入 path
+// 文件头记录旧文件 (old_path) 的大小与修改时间，old_sha256 为空时不记录 SHA256
+bool save_index_file(
+    const std::string& path,
+    const BlockMatcher& matcher,
+    const std::string& old_path, uint64_t old_size,
+    const std::array<uint8_t, 32>* old_sha256,
+    std::string& error
+);
+
+// 映射 path 并校验格式、结构、采样参数以及与旧文件的对应关系，成功后 matcher 直接使用映射中的数组
+// 旧文件: 大小须相同；调用方与索引都有 SHA256 时以 SHA256 为准，否则比较修改时间
+// 采样方式须与 matcher 的参数对 old_size 字节数据建索引时相同
+// 不逐字节校验索引内容: 候选都按实际数据验证，内容损坏只会漏掉匹配
+bool load_index_file(
+    const std::string& path,
+    BlockMatcher& matcher,
+    const std::string& old_path, uint64_t old_size,
+    const std::array<uint8_t, 32>* old_sha256,
+    std::string& error
+);
+
+} // namespace bindiff
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+
+namespace bindiff {
+
+// ============== 匹配长度计算 ==============
+
+// 比较 a 与 b，返回前缀相同的字节数 (不超过 max_len)
+// 根据 CPU 在运行时选择 AVX-512 / AVX2 / SSE2 / 标量实现
+size_t match_length(const byte* a, const byte* b, size_t max_len);
+
+// 从 a_end / b_end (不含) 向前比较，返回末尾相同的字节数 (不超过 max_len)
+// 用于匹配的反向扩展，通常只有几个字节，使用标量实现
+size_t match_length_backward(const byte* a_end, const byte* b_end, size_t max_len);
+
+// ============== 内核选择 ==============
+
+enum class MatchKernel {
+    Scalar,   // 每次 8 字节
+    SSE2,     // 每次 16 字节
+    AVX2,     // 每次 32 字节
+    AVX512,   // 每次 64 字节 (AVX-512BW)
+};
+
+using MatchLengthFn = size_t (*)(const byte* a, const byte* b, size_t max_len);
+
+// 当前 CPU 是否支持该内核
+bool match_kernel_supported(MatchKernel kernel);
+
+// 获取指定内核 (不支持时返回 nullptr)
+MatchLengthFn match_kernel(MatchKernel kernel);
+
+// match_length 实际使用的内核
+MatchKernel active_match_kernel();
+
+const char* match_kernel_name(MatchKernel kernel);
+
+} // namespace bindiff
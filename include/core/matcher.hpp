@@ -2,6 +2,7 @@
 
 #include "types.hpp"
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace bindiff {
@@ -40,6 +41,96 @@ private:
     static uint64_t add_mod(uint64_t a, uint64_t b);
 };
 
+// ============== Buzhash 滚动哈希 ==============
+
+namespace detail {
+
+struct BuzTable {
+    uint64_t values[256];
+};
+
+// splitmix64 生成的固定随机表 (编译期计算)
+constexpr BuzTable make_buz_table() {
+    BuzTable table{};
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < 256; ++i) {
+        state += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        table.values[i] = z ^ (z >> 31);
+    }
+    return table;
+}
+
+inline constexpr BuzTable BUZ_TABLE = make_buz_table();
+
+inline uint64_t rotl64(uint64_t x, unsigned r) {
+    return (x << (r & 63)) | (x >> ((64 - r) & 63));
+}
+
+// 预取一条缓存行 (只读)
+inline void prefetch(const void* addr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(addr, 0, 3);
+#else
+    (void)addr;
+#endif
+}
+
+} // namespace detail
+
+// 循环多项式哈希: 每字节一次查表、旋转、异或，无乘除法
+class BuzHash {
+public:
+    explicit BuzHash(size_t window_size = 32)
+        : hash_(0)
+        , window_size_(window_size)
+        , out_rotate_(static_cast<unsigned>(window_size % 64))
+    {
+    }
+    
+    void init(const byte* data, size_t size) {
+        hash_ = 0;
+        size_t len = size < window_size_ ? size : window_size_;
+        for (size_t i = 0; i < len; ++i) {
+            hash_ = detail::rotl64(hash_, 1) ^ detail::BUZ_TABLE.values[data[i]];
+        }
+    }
+    
+    // 移出 oldest 的贡献 (已被旋转 window_size 次)，加入 newest
+    void roll(byte oldest, byte newest) {
+        hash_ = detail::rotl64(hash_, 1)
+              ^ detail::rotl64(detail::BUZ_TABLE.values[oldest], out_rotate_)
+              ^ detail::BUZ_TABLE.values[newest];
+    }
+    
+    uint64_t hash() const { return hash_; }
+    
+    void reset() { hash_ = 0; }
+    
+    static uint64_t compute(const byte* data, size_t size) {
+        BuzHash bh(size);
+        bh.init(data, size);
+        return bh.hash();
+    }
+
+private:
+    uint64_t hash_;
+    size_t window_size_;
+    unsigned out_rotate_;
+};
+
+// ============== 索引哈希策略 ==============
+
+// 索引构建与查询共用的滚动哈希，编译期选择以便热循环内联
+// 定义 BINDIFF_USE_RABIN_KARP 可切换回 Rabin-Karp
+#if defined(BINDIFF_USE_RABIN_KARP) && BINDIFF_USE_RABIN_KARP
+using IndexHash = RollingHash;
+#else
+using IndexHash = BuzHash;
+#endif
+
 // ============== 块匹配器 ==============
 
 struct Match {
@@ -49,19 +140,49 @@ struct Match {
     bool valid() const { return length > 0; }
 };
 
+// 旧文件中的字节区间 [offset, offset + length)
+struct ByteRange {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    
+    uint64_t end() const { return offset + length; }
+};
+
+// CSR 哈希索引的只读数组: 桶 b 的候选为条目 [bucket_starts[b], bucket_starts[b + 1])
+// 可指向 BlockMatcher 自有的存储，也可指向映射的索引文件
+struct IndexArrays {
+    const uint32_t* bucket_starts = nullptr;   // num_buckets + 1 个
+    const uint32_t* offsets_lo = nullptr;      // 条目偏移低 32 位
+    const uint8_t* offsets_hi = nullptr;       // 条目偏移高 8 位 (仅旧文件 >= 4GB 时存在)
+    const uint8_t* tags = nullptr;             // 条目的 8 位哈希标签
+    size_t num_buckets = 0;                    // 2 的幂
+    size_t num_entries = 0;
+};
+
+class MatchCursor;
+class MMapFile;
+class IndexBuilder;
+
+// 索引构建完成后 BlockMatcher 只读，查询接口均为 const，可被多个线程同时使用
 class BlockMatcher {
 public:
-    explicit BlockMatcher(size_t min_match = 32);
-    ~BlockMatcher() = default;
+    explicit BlockMatcher(size_t min_match = MIN_MATCH_LENGTH);
+    explicit BlockMatcher(const MatcherParams& params);
+    ~BlockMatcher();
     
-    // 在 old 中找 new_data 的最长匹配
+    // 索引数组可能指向自身存储，禁止拷贝
+    BlockMatcher(const BlockMatcher&) = delete;
+    BlockMatcher& operator=(const BlockMatcher&) = delete;
+    
+    // 在 old 中找 new_data 的最长匹配 (一次性查询，需要从头计算窗口哈希)
+    // 连续位置的查询应使用 MatchCursor
     Match find_longest_match(
         const byte* old_data, 
         size_t old_size,
         const byte* new_data, 
         size_t new_size,
         size_t new_offset  // 从 new_data 的哪个位置开始匹配
-    );
+    ) const;
     
     // 批量匹配: 找到所有匹配点
     std::vector<Match> find_all_matches(
@@ -72,21 +193,233 @@ public:
     );
     
     // 构建哈希索引 (加速匹配)
-    void build_index(const byte* data, size_t size, size_t chunk_size = 32);
+    void build_index(const byte* data, size_t size, size_t chunk_size = MIN_MATCH_LENGTH);
     
     // 并行构建索引 (多线程)
-    void build_index_parallel(const byte* data, size_t size, size_t chunk_size = 32, int num_threads = 0);
+    // skip: 不需要建索引的区间 (如已被整块匹配的内容)，完全落在其中的窗口不进入索引
+    void build_index_parallel(const byte* data, size_t size, size_t chunk_size = MIN_MATCH_LENGTH,
+                              int num_threads = 0, const std::vector<ByteRange>& skip = {});
+    
+    // 使用外部构建的索引 (如映射的索引文件)，mapping 在索引使用期间保持映射
+    // step / winnow 为构建时的采样方式，min_match 须与构建时相同
+    void adopt_index(const IndexArrays& arrays, size_t step, size_t winnow,
+                     std::unique_ptr<MMapFile> mapping = nullptr);
+    
+    // 当前索引的数组 (用于写入索引文件)
+    const IndexArrays& index_arrays() const { return index_; }
+    
+    // 索引统计
+    bool has_index() const { return index_.bucket_starts != nullptr; }
+    size_t index_entries() const { return index_.num_entries; }
+    size_t index_buckets() const { return index_.num_buckets; }
+    size_t index_step() const { return step_; }
+    size_t index_winnow() const { return winnow_; }   // 0 表示固定步长采样
+    
+    // 按当前参数为 size 字节的数据建索引时的采样方式 (与 build_index 相同的规则)
+    void plan_sampling(size_t size, size_t& step, size_t& winnow) const;
+    size_t index_memory() const;     // 自有存储占用 (映射的索引文件不计入)
+    
+    size_t min_match() const { return min_match_; }
+    
+    // winnowing 窗口上限 (查询端需要在环形缓冲中保留前后各一个窗口的哈希)
+    static constexpr size_t MAX_WINNOW_WINDOW = 32;
 
 private:
+    friend class MatchCursor;
+    friend class IndexBuilder;
+    
     size_t min_match_;
-    RollingHash hasher_;
+    MatcherParams params_;
+    
+    // CSR 哈希索引: 桶 b 的候选偏移为 entries[bucket_starts_[b] .. bucket_starts_[b + 1])
+    // 偏移按 40 位存储: 低 32 位 + 高 8 位 (仅旧文件 >= 4GB 时分配)
+    // tags_ 保存每个条目的 8 位哈希标签，验证候选前先过滤掉绝大多数冲突
+    // 重复区段 (填充字节等短周期内容) 内的窗口不逐个建索引，每种模式只保留最长区段的各相位条目，
+    // 查询落在重复内容上时桶内只有一个候选
+    // 以下为 build_index 生成的自有存储，查询统一通过 index_ 访问
+    std::vector<uint32_t> bucket_starts_;
+    std::vector<uint32_t> offsets_lo_;
+    std::vector<uint8_t> offsets_hi_;
+    std::vector<uint8_t> tags_;
+    IndexArrays index_;
+    std::unique_ptr<MMapFile> mapping_;     // adopt_index 传入的映射
+    uint64_t bucket_mask_ = 0;
+    size_t step_ = 1;
+    size_t winnow_ = 0;     // winnowing 窗口 (连续窗口哈希个数)，0 表示固定步长采样
+    
+    // 平均每桶条目数
+    static constexpr size_t BUCKET_LOAD = 2;
+    // 构建时每个分区的桶数
+    static constexpr size_t BUCKETS_PER_PARTITION = 16384;
+    // 构建时标记落在跳过区间内的条目
+    static constexpr uint32_t SKIPPED_ENTRY = UINT32_MAX;
+    
+    // 采样步长: 按文件大小取预设步长，条目数超出上限时继续增大，保证整个文件均匀覆盖
+    size_t sampling_step(size_t size, size_t chunk_size) const;
+    
+    // winnowing 窗口: 由保证长度推导，条目数超出上限时增大；超过 MAX_WINNOW_WINDOW 时返回 0 (退回固定步长)
+    size_t winnow_window(size_t size, size_t chunk_size) const;
+    
+    size_t entry_offset(size_t i) const {
+        size_t off = index_.offsets_lo[i];
+        if (index_.offsets_hi) {
+            off |= static_cast<size_t>(index_.offsets_hi[i]) << 32;
+        }
+        return off;
+    }
+    
+    // 在索引中查找窗口哈希为 window_hash 的最长匹配
+    Match probe_index(
+        uint64_t window_hash,
+        const byte* old_data, size_t old_size,
+        const byte* new_data, size_t new_size,
+        size_t new_offset
+    ) const;
+    
+    // 无索引时的滑动窗口搜索
+    Match scan_without_index(
+        const byte* old_data, size_t old_size,
+        const byte* new_data, size_t new_size,
+        size_t new_offset
+    ) const;
+    
+    // 扫描时分两级预取: 先取桶起始位置，再取桶内标签与偏移
+    void prefetch_bucket(uint64_t hash) const {
+        detail::prefetch(index_.bucket_starts + hash_to_bucket(hash));
+    }
+    void prefetch_candidates(uint64_t hash) const {
+        size_t first = index_.bucket_starts[hash_to_bucket(hash)];
+        detail::prefetch(index_.tags + first);
+    }
+    
+    uint64_t compute_chunk_hash(const byte* data, size_t size) const;
+    size_t hash_to_bucket(uint64_t hash) const {
+        return static_cast<size_t>(hash & bucket_mask_);
+    }
+    // 标签取桶号之外的哈希位
+    static uint8_t hash_to_tag(uint64_t hash) {
+        return static_cast<uint8_t>(hash >> 40);
+    }
+};
+
+// ============== 分段构建索引 ==============
+
+// 把数据按 segment_size 分段收集索引条目，全部收集后一次建成 matcher 的 CSR 索引
+// 各段的 collect 互不依赖，可在不同线程中以任意顺序调用 (如在处理对应数据块的任务中顺带收集)
+// 构造时确定采样方式并释放 matcher 的旧索引；finish 之前 matcher 不可查询
+class IndexBuilder {
+public:
+    // skip: 同 build_index_parallel；num_threads 用于查找重复区段与合并
+    IndexBuilder(BlockMatcher& matcher, const byte* data, size_t size, size_t chunk_size,
+                 size_t segment_size, int num_threads, const std::vector<ByteRange>& skip = {});
+    
+    // 分段数 (按数据大小向上取整)
+    size_t segments() const { return num_segments_; }
+    
+    // 收集窗口起点落在第 segment 段内的条目
+    void collect(size_t segment);
+    
+    // 合并各段条目，写入 matcher (所有段都已收集后调用一次)；数据短于一个窗口时写入没有条目的空索引
+    void finish();
+
+private:
+    // 一段的条目。固定步长采样时不存偏移: 第 k 个条目位于 base + k * step，跳过的条目哈希记为 SKIPPED_ENTRY
+    // 其余 (winnowing 与重复区段的代表条目) 只存未跳过的条目及其相对 base 的偏移
+    struct Segment {
+        uint64_t base = 0;
+        size_t entries = 0;                 // 进入索引的条目数
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> hashes;       // 窗口哈希的低 31 位 (桶数不超过 2^31)
+        std::vector<uint8_t> tags;
+    };
+    
+    static constexpr uint32_t HASH_BITS = 0x7FFFFFFF;
+    static constexpr uint32_t SKIPPED_ENTRY = UINT32_MAX;
+    
+    uint64_t entry_offset(const Segment& segment, size_t e) const {
+        return segment.offsets.empty() ? segment.base + e * matcher_.step_ : segment.base + segment.offsets[e];
+    }
+    
+    // offset 处的窗口是否完全落在跳过区间内 (range 为当前检查到的区间，随 offset 递增前移)
+    bool skipped(size_t& range, uint64_t offset) const;
+    
+    BlockMatcher& matcher_;
+    const byte* data_;
+    size_t size_;
+    size_t chunk_size_;
+    size_t segment_size_;
+    int num_threads_;
+    size_t num_segments_ = 0;
+    size_t positions_ = 0;                  // 窗口起点个数
+    std::vector<ByteRange> ranges_;         // 跳过区间 (已排序合并)
+    std::vector<Segment> segments_;         // 各段的采样条目，之后是重复区段的代表条目
+};
+
+// ============== 匹配游标 ==============
+
+// 单个线程在新数据上的查询状态 (滚动哈希 + 当前位置)
+// 每个工作线程在栈上持有自己的游标，共享的 BlockMatcher 不被修改
+class MatchCursor {
+public:
+    MatchCursor(
+        const BlockMatcher& matcher,
+        const byte* old_data, size_t old_size,
+        const byte* new_data, size_t new_size
+    );
+    
+    // 定位到 new_data 的 pos: 向前移动时沿用已滚动的哈希，否则重新计算窗口哈希
+    void seek(size_t pos);
+    
+    // 前进一个字节
+    void advance() { seek(pos_ + 1); }
+    
+    size_t position() const { return pos_; }
+    
+    // 当前位置之后是否还有完整窗口
+    bool has_window() const { return pos_ + window_ <= new_size_; }
+    
+    // 查找当前位置的最长匹配
+    Match find();
+    
+    // 从当前位置逐字节滚动扫描，直到找到匹配、到达 limit 或没有完整窗口
+    // 找到时游标停在匹配起点并返回该匹配；否则返回无效匹配
+    // winnowing 索引下只查询被选中的位置 (与建索引相同的规则)
+    // 固定步长索引下连续未命中时逐渐增大查询间隔，命中时补查跳过的位置，仍停在最早的匹配起点
+    Match scan(size_t limit = SIZE_MAX);
+
+private:
+    // 预先计算的哈希个数 (用于预取索引)
+    static constexpr size_t LOOKAHEAD = 32;
+    // 环形缓冲大小: 除预先计算的哈希外，还保留当前位置之前一个 winnowing 窗口的哈希
+    static constexpr size_t RING_SIZE = LOOKAHEAD + BlockMatcher::MAX_WINNOW_WINDOW;
+    // 第二级预取 (桶内候选) 落后于第一级 (桶起始位置) 的距离
+    static constexpr size_t PREFETCH_DISTANCE = LOOKAHEAD / 2;
+    // 每连续未命中 SKIP_TRIGGER 次查询，查询间隔加 1，至多 MAX_SKIP
+    static constexpr size_t SKIP_TRIGGER = 32;
+    static constexpr size_t MAX_SKIP = 8;
+    
+    // 计算 [front_, end) 位置的窗口哈希，并为按当前间隔会被查询的位置发起预取
+    void fill_ahead(size_t end);
+    
+    // pos 处的窗口哈希是否为某个完整 winnowing 窗口的最右最小值 (需已计算 pos 前后各 winnow - 1 个哈希)
+    bool winnowed(size_t pos) const;
+    
+    // 连续未命中 misses 次后的查询间隔: 与采样步长互素，连续的查询依次落在各个采样相位上
+    size_t scan_skip(size_t misses) const;
     
-    // 哈希表: hash -> offset
-    std::vector<std::vector<size_t>> hash_table_;
-    static constexpr size_t HASH_BUCKETS = 65536;
+    const BlockMatcher& matcher_;
+    const byte* old_data_;
+    size_t old_size_;
+    const byte* new_data_;
+    size_t new_size_;
+    size_t window_;
     
-    uint64_t compute_chunk_hash(const byte* data, size_t size);
-    size_t hash_to_bucket(uint64_t hash) const;
+    IndexHash hasher_;              // rolled_ 时对应 front_ - 1 处的窗口
+    bool rolled_;
+    size_t pos_;
+    size_t front_;                  // ring_ 保存 front_ 之前 (至多 RING_SIZE 个) 已计算位置的哈希
+    size_t skip_;                   // scan 当前的查询间隔
+    uint64_t ring_[RING_SIZE];
 };
 
 } // namespace bindiff
@@ -11,6 +11,9 @@ namespace bindiff {
 enum class OpCode : uint8_t {
     COPY = 0x00,    // 从旧文件复制
     INSERT = 0x01,  // 插入新数据
+    FILL = 0x02,    // 重复单个字节 (填充)
+    COPY_NEW = 0x03,  // 从本块已重建的输出复制 (块内偏移)
+    ADD = 0x04,     // 旧文件字节逐字节加上差值 (近似匹配，类似 bsdiff)
 };
 
 // ============== 操作指令 ==============
@@ -18,12 +21,18 @@ enum class OpCode : uint8_t {
 struct Operation {
     OpCode opcode;
     
-    // COPY 操作的数据
+    // COPY / COPY_NEW / ADD 操作的数据 (COPY_NEW 的偏移相对块起点)
     uint64_t copy_offset = 0;
     uint32_t copy_length = 0;
     
-    // INSERT 操作的数据
-    std::vector<byte> insert_data;
+    // INSERT 的数据 / ADD 的差值 (新字节 - 旧字节，长度等于 copy_length)
+    // 不持有数据: 生成补丁时指向新文件或差值缓冲区，应用补丁时指向块数据，使用期间须保持有效
+    const byte* data = nullptr;
+    uint32_t data_length = 0;
+    
+    // FILL 操作的数据
+    byte fill_value = 0;
+    uint32_t fill_length = 0;
     
     // 构造函数
     static Operation copy(uint64_t offset, uint32_t length) {
@@ -37,35 +46,108 @@ struct Operation {
     static Operation insert(const byte* data, size_t size) {
         Operation op;
         op.opcode = OpCode::INSERT;
-        op.insert_data.assign(data, data + size);
+        op.data = data;
+        op.data_length = static_cast<uint32_t>(size);
         return op;
     }
     
-    static Operation insert(const std::vector<byte>& data) {
+    static Operation copy_new(uint32_t offset, uint32_t length) {
         Operation op;
-        op.opcode = OpCode::INSERT;
-        op.insert_data = data;
+        op.opcode = OpCode::COPY_NEW;
+        op.copy_offset = offset;
+        op.copy_length = length;
+        return op;
+    }
+    
+    // diff[i] = 新字节 - 旧字节 (模 256)，见 compute_diff
+    static Operation add(uint64_t offset, const byte* diff, size_t length) {
+        Operation op;
+        op.opcode = OpCode::ADD;
+        op.copy_offset = offset;
+        op.copy_length = static_cast<uint32_t>(length);
+        op.data = diff;
+        op.data_length = static_cast<uint32_t>(length);
+        return op;
+    }
+    
+    static void compute_diff(const byte* old_data, const byte* new_data, size_t length, byte* diff) {
+        for (size_t i = 0; i < length; ++i) {
+            diff[i] = static_cast<byte>(new_data[i] - old_data[i]);
+        }
+    }
+    
+    static Operation fill(byte value, uint32_t length) {
+        Operation op;
+        op.opcode = OpCode::FILL;
+        op.fill_value = value;
+        op.fill_length = length;
         return op;
     }
     
-    // 序列化
+    // v1 格式的序列化大小 (v2 通常更小)
     size_t serialized_size() const {
         if (opcode == OpCode::COPY) {
             return 1 + 8 + 4;  // opcode + offset + length
+        } else if (opcode == OpCode::FILL) {
+            return 1 + 1 + 4;  // opcode + value + length
+        } else if (opcode == OpCode::COPY_NEW) {
+            return 1 + 4 + 4;  // opcode + offset + length
+        } else if (opcode == OpCode::ADD) {
+            return 1 + 8 + 4 + data_length;  // opcode + offset + length + diff
         } else {
-            return 1 + 4 + insert_data.size();  // opcode + length + data
+            return 1 + 4 + data_length;  // opcode + length + data
         }
     }
 };
 
 // ============== 序列化 ==============
 
+// 操作流格式，与补丁格式版本 (PatchHeader::version) 相同
+// v1: 定长小端字段，COPY 13 字节、INSERT 头 5 字节
+// v2: 长度为 LEB128 变长整数；COPY / ADD 的旧文件偏移记为相对上一个 COPY / ADD 终点的 zigzag 差值，
+//     COPY_NEW 的来源记为距当前输出位置的距离
+// v3: 与 v2 相同的字段，但 INSERT 数据与 ADD 差值分别放入独立的流 (OperationStreams)
+constexpr uint16_t OP_FORMAT_V1 = 1;
+constexpr uint16_t OP_FORMAT_V2 = 2;
+constexpr uint16_t OP_FORMAT_V3 = 3;
+
+// v2 相对编码的基准，每块从零开始，编码与解码两端按相同顺序更新
+struct OperationContext {
+    uint64_t old_position = 0;      // 上一个 COPY / ADD 在旧文件中的终点
+    uint64_t output_position = 0;   // 块内已输出的字节数
+};
+
+// v3 的三个流: 结构化的字段与不透明的数据分开压缩
+struct OperationStreams {
+    std::vector<byte> control;    // 操作码与变长字段
+    std::vector<byte> literals;   // INSERT 数据
+    std::vector<byte> diffs;      // ADD 差值
+};
+
+// 解码 v3 时 literals / diffs 流的读取位置
+struct StreamCursor {
+    const byte* data = nullptr;
+    size_t size = 0;
+    size_t position = 0;
+    
+    // 取出接下来的 length 字节，不足时返回 nullptr
+    const byte* take(size_t length) {
+        if (size - position < length) {
+            return nullptr;
+        }
+        position += length;
+        return data + position - length;
+    }
+    
+    bool exhausted() const { return position == size; }
+};
+
 class OperationSerializer {
 public:
-    // 序列化操作到字节流
+    // 序列化操作到字节流 (v1)
     static void serialize(const Operation& op, std::vector<byte>& output);
     
-    // 从字节流反序列化
+    // 从字节流反序列化 (v1)
     // 返回: 读取的字节数，0 表示失败
     static size_t deserialize(
         const byte* data, 
@@ -73,14 +155,64 @@ public:
         Operation& op
     );
     
-    // 批量序列化
+    // v2: 按 context 做相对编码，并更新 context
+    static void serialize(const Operation& op, OperationContext& context, std::vector<byte>& output);
+    
+    // v2: 返回读取的字节数，0 表示失败 (包括 COPY_NEW 来源超出已输出部分)
+    static size_t deserialize(
+        const byte* data,
+        size_t size,
+        Operation& op,
+        OperationContext& context
+    );
+    
+    // v3: 字段写入 control 流，数据写入 literals / diffs 流
+    static void serialize(const Operation& op, OperationContext& context, OperationStreams& streams);
+    
+    // v3: 从 control 流读取字段，返回读取的字节数；数据从 literals / diffs 流按顺序取出
+    static size_t deserialize(
+        const byte* control,
+        size_t size,
+        Operation& op,
+        OperationContext& context,
+        StreamCursor& literals,
+        StreamCursor& diffs
+    );
+    
+    // 批量序列化 (一个块的全部操作)
+    static void serialize_all(
+        const std::vector<Operation>& ops,
+        std::vector<byte>& output,
+        uint16_t format_version = OP_FORMAT_V1
+    );
+    
+    // 批量序列化为 v3 的三个流
     static void serialize_all(
         const std::vector<Operation>& ops,
-        std::vector<byte>& output
+        OperationStreams& streams
     );
     
     // 计算总大小
     static size_t total_size(const std::vector<Operation>& ops);
+
+private:
+    // v2 / v3 共用: v2 时三个输出为同一缓冲区，解码时 literals / diffs 为空表示数据紧跟在字段之后
+    static void encode(
+        const Operation& op,
+        OperationContext& context,
+        std::vector<byte>& control,
+        std::vector<byte>& literals,
+        std::vector<byte>& diffs
+    );
+    
+    static size_t decode(
+        const byte* data,
+        size_t size,
+        Operation& op,
+        OperationContext& context,
+        StreamCursor* literals,
+        StreamCursor* diffs
+    );
 };
 
 } // namespace bindiff
@@ -4,10 +4,13 @@
 #include "core/patch_format.hpp"
 #include "io/mmap_file.hpp"
 #include "compress/compressor.hpp"
+#include "core/matcher.hpp"
 #include <memory>
 
 namespace bindiff {
 
+class BlockProcessor;
+
 // ============== 补丁引擎 ==============
 
 class PatchEngine {
@@ -28,13 +31,22 @@ private:
         MMapFile& old_file,
         const std::string& patch_path,
         const std::string& output_path,
-        ProgressCallback* callback
+        ProgressCallback* callback,
+        std::string& error
     );
-    bool reconstruct_block_from_data(
-        MMapFile& old_file,
-        const std::vector<uint8_t>& compressed_data,
+    // 由块在补丁中的数据 (含 8 字节块头) 重建第 index 块到 output (可在多个线程中同时调用)
+    // mapped_output 非空时 output 位于新建的输出映射中: FILL 0 不写入，足够长的零区间释放空间留作空洞
+    // zero_fills 返回 FILL 0 写出的区间 (相对块起点)，供写出时跳过
+    bool reconstruct_block_at(
+        BlockProcessor& processor,
+        const MMapFile& old_file,
+        uint32_t index,
+        const uint8_t* block_data,
+        size_t block_data_size,
         uint8_t* output,
-        size_t output_size
+        size_t output_size,
+        MMapFile* mapped_output,
+        std::vector<ByteRange>& zero_fills
     );
     
     PatchOptions options_;
@@ -12,7 +12,7 @@ namespace bindiff {
 
 struct PatchHeader {
     char     magic[4];        // 4 bytes  - "UEBD"
-    uint16_t version;         // 2 bytes  - 格式版本 (1)
+    uint16_t version;         // 2 bytes  - 格式版本 (3；1、2 仍可读取)
     uint16_t flags;           // 2 bytes  - 保留
     uint32_t block_size;      // 4 bytes  - 块大小
     uint64_t old_size;        // 8 bytes  - 原文件大小
@@ -25,7 +25,8 @@ struct PatchHeader {
     
     static constexpr size_t SIZE = 100;
     static constexpr const char* MAGIC = "UEBD";
-    static constexpr uint16_t VERSION = 1;
+    static constexpr uint16_t VERSION = 3;       // 写出的版本: 块数据分为三个流 (OP_FORMAT_V3)
+    static constexpr uint16_t MIN_VERSION = 1;   // 仍可读取的最低版本
     
     bool is_valid() const;
     void init(uint32_t blk_size, uint64_t old_sz, uint64_t new_sz);
@@ -33,6 +34,27 @@ struct PatchHeader {
 
 #pragma pack(pop)
 
+// ============== 块数据的流 (v3) ==============
+
+#pragma pack(push, 1)
+
+// 块数据: [StreamHeader × 3] [control] [literals] [diffs]
+// 三个流 (见 OperationStreams) 各自选择编码，压缩后不更小时原样存储
+struct StreamHeader {
+    uint8_t  codec;           // 1 byte  - CompressionType
+    uint32_t raw_size;        // 4 bytes - 解码后大小
+    uint32_t stored_size;     // 4 bytes - 块数据中的大小
+    // 总计: 9 bytes
+    
+    static constexpr size_t SIZE = 9;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(StreamHeader) == StreamHeader::SIZE, "StreamHeader must be 9 bytes");
+
+constexpr size_t BLOCK_STREAM_COUNT = 3;
+
 // ============== 块索引 ==============
 
 struct BlockIndex {
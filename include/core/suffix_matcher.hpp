@@ -0,0 +1,109 @@
+#pragma once
+
+#include "core/matcher.hpp"
+#include "types.hpp"
+#include <vector>
+
+namespace bindiff {
+
+// ============== 后缀数组匹配器 ==============
+
+// 基于后缀数组 (SA-IS) 的最长匹配查找，用于最大压缩模式
+// 旧文件被切分为若干段，每段独立构建后缀数组 (段内 32 位偏移)，
+// 可并行构建；查询时在每段中二分查找，返回全局 64 位偏移
+// 每段向后多覆盖一段重叠区，段尾开始的后缀按之后的实际内容排序，跨越段边界的匹配不会丢失
+class SuffixMatcher {
+public:
+    // sample_step: 扫描时每隔几个位置查找一次 (0 表示按 min_match 取默认值)
+    explicit SuffixMatcher(size_t min_match = MIN_MATCH_LENGTH, size_t sample_step = 0);
+
+    // 构建后缀数组 (segment_size = 0 时使用默认段大小)
+    void build(const byte* data, size_t size, int num_threads = 1, size_t segment_size = 0);
+
+    // 查找 new_data[new_offset..] 在旧数据中的最长匹配，短于 min_length (0 表示 min_match) 时返回无效匹配
+    Match find_longest_match(
+        const byte* old_data, size_t old_size,
+        const byte* new_data, size_t new_size,
+        size_t new_offset,
+        size_t min_length = 0
+    ) const;
+
+    bool has_index() const { return !segments_.empty(); }
+    size_t num_segments() const { return segments_.size(); }
+    size_t index_memory() const;
+    size_t min_match() const { return min_match_; }
+    size_t sample_step() const { return sample_step_; }
+
+    // 默认段大小: 构建时每个线程额外需要约 1.5 倍段大小的临时内存
+    static constexpr size_t DEFAULT_SEGMENT_SIZE = 256 * MB;
+
+    // 最大段大小 (含重叠区): 段内偏移必须能用 int32 表示
+    static constexpr size_t MAX_SEGMENT_SIZE = (size_t(1) << 31) - 1;
+    
+    // 段间重叠上限 (不超过段大小的 1/4): 从段尾开始、在下一段继续的匹配在这个长度内按完整内容比较，
+    // 更长的部分查找后再向后扩展
+    static constexpr size_t SEGMENT_OVERLAP = 1 * MB;
+
+private:
+    struct Segment {
+        size_t begin;   // 段在旧文件中的起始偏移
+        size_t size;    // 后缀数组覆盖的字节数 (含与下一段的重叠区)
+        size_t sa_begin;                // 在 suffix_array_ 中的起点
+        size_t prefix_bytes;            // 桶表按前几个字节划分 (2 或 3)
+        std::vector<uint32_t> buckets;  // 每个前缀对应的后缀数组区间起点
+    };
+    
+    // 一级桶表: 查询先按前缀定位区间再二分，无匹配的位置可快速排除
+    // 大段使用 3 字节前缀 (64MB 桶表)，小段使用 2 字节前缀
+    static constexpr size_t LARGE_PREFIX_MIN_SEGMENT = 64 * MB;
+    
+    static uint32_t prefix_key(const byte* p, size_t len, size_t prefix_bytes);
+    static void build_buckets(Segment& segment, const byte* data);
+
+    // 在单个段中二分查找，返回段内最长公共前缀的匹配 (全局偏移)
+    Match search_segment(
+        const Segment& segment,
+        const byte* old_data,
+        const byte* key, size_t key_len
+    ) const;
+
+    size_t min_match_;
+    size_t sample_step_;
+    std::vector<Segment> segments_;
+
+    // 各段的后缀数组首尾相接存放: 段 s 占用 [sa_begin, sa_begin + size)，内容为段内偏移
+    std::vector<uint32_t> suffix_array_;
+};
+
+// ============== 后缀数组游标 ==============
+
+// 与 MatchCursor 接口相同，使 BlockProcessor 可以对两种匹配器使用同一套编码循环
+class SuffixCursor {
+public:
+    SuffixCursor(const SuffixMatcher& matcher,
+                 const byte* old_data, size_t old_size,
+                 const byte* new_data, size_t new_size);
+
+    void seek(size_t pos) { pos_ = pos; }
+    void advance() { ++pos_; }
+    size_t position() const { return pos_; }
+    bool has_window() const { return pos_ + matcher_.min_match() <= new_size_; }
+
+    // 查询当前位置的最长匹配
+    Match find() const;
+
+    // 从当前位置向前推进，直到找到匹配、到达 limit 或数据结束
+    // 每次查找都是完整的二分查找，只在 sample_step 的整数倍位置进行: 采样位置的匹配向前扩展 (不越过扫描起点)
+    // 后达到 min_match 即返回，游标停在扩展后的起点。长度 >= min_match + sample_step - 1 的匹配不会漏掉
+    Match scan(size_t limit = SIZE_MAX);
+
+private:
+    const SuffixMatcher& matcher_;
+    const byte* old_data_;
+    size_t old_size_;
+    const byte* new_data_;
+    size_t new_size_;
+    size_t pos_ = 0;
+};
+
+} // namespace bindiff
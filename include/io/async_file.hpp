@@ -0,0 +1,97 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace bindiff {
+
+// ============== 异步文件读写 ==============
+
+// 按偏移读写同一文件的请求队列，最多 queue_depth 个请求同时在途 (队列满时提交会先等待一个完成)
+// io_uring 后端先把请求排队，submit() 或等待时一次交给内核并发执行；同步后端 (pread/pwrite) 在提交时即完成
+// 由一个线程提交与等待；请求完成 (wait_one 返回其 tag) 之前缓冲区须保持有效
+class AsyncFile {
+public:
+    enum class Mode {
+        Read,         // 只读
+        Write,        // 新建或截断后读写
+        WriteDirect,  // 同 Write，绕过页缓存 (O_DIRECT)；文件系统不支持时为普通写入，见 direct()
+    };
+    
+    // 直接 I/O 时缓冲区地址、长度与文件偏移须按此对齐
+    static constexpr size_t DIRECT_ALIGN = 4096;
+
+    // 打开 path，失败时返回空并设置 error
+    static std::unique_ptr<AsyncFile> open(
+        const std::string& path,
+        Mode mode,
+        const IoOptions& options,
+        std::string& error
+    );
+
+    virtual ~AsyncFile();
+
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+
+    // 提交请求 (短读写自动续传，读到文件末尾之前结束视为失败)
+    // 返回 false 表示提交失败或已有请求失败
+    virtual bool submit_read(void* buffer, size_t length, uint64_t offset, uint64_t tag = 0) = 0;
+    virtual bool submit_write(const void* buffer, size_t length, uint64_t offset, uint64_t tag = 0) = 0;
+    
+    // 把已排队的请求交给内核开始执行 (不等待)；之后要先做别的事时调用，wait_one 会自行提交
+    virtual bool submit() { return !failed_; }
+
+    // 等待任一请求完成并取出其 tag；没有在途请求或请求失败时返回 false
+    bool wait_one(uint64_t& tag);
+
+    // 等待全部请求完成
+    bool wait_all();
+
+    // 已提交、尚未被 wait_one 取出的请求数
+    size_t pending() const { return in_flight_ + completed_.size(); }
+
+    // 设置文件大小 (扩展部分读出为零，支持稀疏文件的文件系统上不占空间)
+    bool resize(uint64_t size);
+
+    uint64_t size() const;
+    
+    // 是否以直接 I/O 写入 (打开或写入时被拒绝后退回普通写入)
+    bool direct() const { return direct_; }
+    
+    // 开始把区间内的脏页写回磁盘 (不等待)
+    void start_writeback(uint64_t offset, uint64_t length);
+    
+    // 等待区间写回完成并移出页缓存 (posix_fadvise DONTNEED)，大文件的写入不挤掉其他文件的缓存
+    void drop_cache(uint64_t offset, uint64_t length);
+    uint32_t queue_depth() const { return queue_depth_; }
+    virtual const char* backend_name() const = 0;
+    const std::string& error() const { return error_; }
+
+protected:
+    AsyncFile(intptr_t handle, uint32_t queue_depth, bool direct);
+
+    // 等待内核完成至少一个请求，完成的 tag 放入 completed_
+    virtual bool reap() = 0;
+
+    bool fail(const std::string& message);
+    
+    // 写入因对齐等原因被拒绝 (EINVAL) 时关闭直接 I/O，之后的请求按普通写入
+    bool disable_direct();
+
+    intptr_t handle_;               // 文件描述符 (Windows: HANDLE)
+    uint32_t queue_depth_;
+    size_t in_flight_ = 0;          // 已提交、内核尚未完成的请求数
+    std::deque<uint64_t> completed_;
+    bool direct_;
+    bool failed_ = false;
+    std::string error_;
+};
+
+// 后端名称 (用于日志)
+const char* io_backend_name(IoBackend backend);
+
+} // namespace bindiff
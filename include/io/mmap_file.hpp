@@ -25,9 +25,14 @@ public:
     // 打开文件 (只读)
     bool open(const std::string& path);
     
-    // 创建文件 (读写)
+    // 创建文件 (读写): 截断或新建 path，预分配 size 字节并共享映射，写入映射即写入文件
+    // 预分配 (fallocate) 使磁盘空间不足在这里报错，而不是在写入映射时触发 SIGBUS；
+    // 文件系统不支持预分配时只设置大小 (preallocated() 为 false，写入映射时仍可能因空间不足而 SIGBUS)
     bool create(const std::string& path, uint64_t size);
     
+    // create() 是否已为整个文件预分配磁盘空间
+    bool preallocated() const { return preallocated_; }
+    
     // 关闭
     void close();
     
@@ -44,9 +49,13 @@ public:
     // 获取映射区域
     byte_view view(uint64_t offset, size_t length) const;
     
-    // 同步到磁盘
+    // 同步到磁盘 (可写映射: msync，失败时 error() 给出原因)
     bool flush();
     
+    // 释放 [offset, offset + length) 的磁盘空间，读出为零 (仅可写映射；不支持时返回 false，内容不变)
+    // 区间须按文件系统块对齐
+    bool punch_hole(uint64_t offset, uint64_t length);
+    
     // 错误信息
     const std::string& error() const { return error_; }
 
@@ -55,9 +64,11 @@ private:
     void* mapping_;     // 映射句柄 (Windows)
     byte* data_;
     uint64_t size_;
+    bool preallocated_;
     std::string error_;
     
     bool map_file(const std::string& path, bool read_only);
+    bool create_file(const std::string& path, uint64_t size);
     bool unmap_file();
 };
 
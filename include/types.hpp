@@ -30,15 +30,85 @@ struct Result {
 
 // ============== 选项 ==============
 
+// 匹配后端
+enum class MatchMode {
+    Hash,         // 采样哈希索引 (默认，速度快)
+    SuffixArray,  // 后缀数组 (最大压缩，构建耗时且每字节约需 4 字节内存)
+};
+
+// 文件读写后端
+enum class IoBackend {
+    Auto,         // io_uring 可用时使用，否则 pread/pwrite
+    IoUring,      // io_uring (Linux)，不可用时报错
+    Sync,         // pread/pwrite，逐个请求同步完成
+};
+
+// 补丁文件与输出文件的读写方式
+struct IoOptions {
+    IoBackend backend = IoBackend::Auto;
+    uint32_t queue_depth = 32;                // 同时在途的读写请求数
+};
+
+// 哈希索引与查询参数 (默认值即 effort 5 的预设)
+struct MatcherParams {
+    size_t min_match = 32;                    // 最短匹配长度，同时是索引哈希窗口长度
+    size_t sample_step_large = 4;             // 旧文件 > 100MB 时的索引采样步长
+    size_t sample_step_huge = 8;              // 旧文件 > 1GB 时的索引采样步长
+    size_t max_index_entries = size_t(1) << 27;  // 索引条目上限，超过时继续增大步长
+    size_t max_probes = 200;                  // 单次查询最多验证的候选数
+    size_t good_match = 4096;                 // 找到该长度的匹配后不再验证其余候选
+    size_t scan_good_match = 1024;            // 无索引扫描时的提前退出长度
+    
+    // > 0 时改用 winnowing 采样: 长度 >= winnow_guarantee 的公共区域保证能被找到
+    // 取 min_match + 2 * 步长 - 2 (如 38、46) 时索引规模与固定步长采样相当
+    size_t winnow_guarantee = 0;
+};
+
 struct DiffOptions {
     uint32_t block_size = 64 * 1024 * 1024;  // 64MB
     int compression_level = 1;                // LZ4: 1-12
     int num_threads = 0;                      // 0 = auto (hardware concurrency)
     bool verify = true;
+    MatchMode match_mode = MatchMode::Hash;
+    bool chunk_matching = false;              // 先用内容定义分块 (FastCDC) 匹配整块，只对空隙做细粒度匹配
+    uint32_t lazy_lookahead = 0;              // 惰性匹配向后检查的位置数，0 = 贪心
+    bool self_copy = true;                    // 旧数据中没有、块内重复出现的内容用 COPY_NEW 引用已输出的部分
+    bool delta_add = true;                    // COPY 之后只有零星字节不同的区间用 ADD (逐字节差值) 编码
+    MatcherParams matcher;
+    
+    // 1-9: 按预设统一设置 matcher (winnow_guarantee 除外)、compression_level、lazy_lookahead、self_copy 与 delta_add
+    // (覆盖上面的单独设置)
+    // 0: 使用各项单独设置
+    int effort = 0;
+    
+    // 预先构建的旧文件索引 (bindiff index 生成)，为空时现场构建
+    // 仅用于哈希匹配模式；索引已覆盖整个旧文件，chunk_matching 不再缩减索引
+    std::string index_path;
+    
+    // 非空时在 diff 的同时构建新文件的索引并写入该路径，下一次以新文件为原文件时直接使用
+    // 与分块匹配并行进行；校验开启时复用已算出的新文件 SHA256
+    std::string emit_index_path;
+    
+    // 补丁文件的写入方式
+    IoOptions io;
 };
 
 struct PatchOptions {
     bool verify = true;
+    int num_threads = 0;                      // 并行重建的线程数，0 = auto (hardware concurrency)
+    
+    // 较长的零填充 (FILL 0) 不写入输出文件，留作空洞 (稀疏文件)
+    bool sparse_output = true;
+    
+    // 块直接重建到输出文件的可写映射中，省去块缓冲区及其写出拷贝；创建映射失败时改为逐块写入
+    bool mmap_output = true;
+    
+    // 补丁文件的读取与 (不映射时) 输出文件的写入方式
+    IoOptions io;
+    
+    // 绕过页缓存写出输出文件 (O_DIRECT，不映射输出)，超大输出不挤掉重建中仍要读取的原文件缓存；
+    // 文件系统不支持时按普通写入，已写出的块写回后移出页缓存
+    bool direct_output = false;
 };
 
 // ============== 进度回调 ==============
@@ -80,6 +150,15 @@ Result create_diff(
     ProgressCallback* callback = nullptr
 );
 
+// 构建旧文件的哈希索引并写入 index_path，供之后的 create_diff 通过 DiffOptions::index_path 复用
+// 使用 options 中的 matcher / effort / num_threads 设置
+Result create_index(
+    const std::string& old_path,
+    const std::string& index_path,
+    const DiffOptions& options = {},
+    ProgressCallback* callback = nullptr
+);
+
 Result apply_patch(
     const std::string& old_path,
     const std::string& patch_path,
@@ -110,8 +189,16 @@ constexpr size_t GB = 1024 * MB;
 // 默认块大小: 64MB
 constexpr size_t DEFAULT_BLOCK_SIZE = 64 * MB;
 
-// 最小匹配长度
-constexpr size_t MIN_MATCH_LENGTH = 32;
+// 默认最短匹配长度 (取自 MatcherParams 的默认值，各处不另写数值)
+// 编码时的阈值按实际使用的匹配器的 min_match，压缩等级预设可以不同
+constexpr size_t MIN_MATCH_LENGTH = MatcherParams{}.min_match;
+
+// 最小填充长度: 新数据中不短于此的单字节重复 (且未被 COPY 覆盖) 编码为 FILL
+constexpr size_t MIN_FILL_LENGTH = 64;
+
+// effort 等级范围 (DiffOptions::effort)
+constexpr int MIN_EFFORT = 1;
+constexpr int MAX_EFFORT = 9;
 
 // 格式化大小 (人类可读)
 inline std::string format_size(uint64_t bytes) {
@@ -1,10 +1,15 @@
 #include "types.hpp"
 #include "core/diff_engine.hpp"
+#include "core/index_file.hpp"
+#include "core/matcher.hpp"
 #include "core/patch_engine.hpp"
 #include "core/patch_format.hpp"
 #include "io/file_utils.hpp"
+#include "io/mmap_file.hpp"
 #include "crypto/sha256.hpp"
+#include <chrono>
 #include <fstream>
+#include <thread>
 
 namespace bindiff {
 
@@ -19,6 +24,56 @@ Result create_diff(
     return engine.create_diff(old_path, new_path, patch_path, callback);
 }
 
+Result create_index(
+    const std::string& old_path,
+    const std::string& index_path,
+    const DiffOptions& options,
+    ProgressCallback* callback
+) {
+    Result result;
+    auto start = std::chrono::high_resolution_clock::now();
+    DiffOptions resolved = resolve_effort(options);
+    
+    MMapFile old_file;
+    if (!old_file.open(old_path)) {
+        result.error = "无法打开原文件: " + old_file.error();
+        return result;
+    }
+    
+    if (callback) {
+        callback->on_progress(0.0f, "计算原文件 SHA256");
+    }
+    auto old_hash = SHA256::compute(old_file.data(), old_file.size());
+    
+    if (callback) {
+        callback->on_progress(0.2f, "构建全局索引");
+    }
+    int threads = resolved.num_threads;
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads <= 0) threads = 4;
+    }
+    BlockMatcher matcher(resolved.matcher);
+    matcher.build_index_parallel(old_file.data(), old_file.size(), resolved.matcher.min_match, threads);
+    
+    if (callback) {
+        callback->on_progress(0.9f, "写入索引文件");
+    }
+    if (!save_index_file(index_path, matcher, old_path, old_file.size(), &old_hash, result.error)) {
+        return result;
+    }
+    
+    auto end = std::chrono::high_resolution_clock::now();
+    result.success = true;
+    result.bytes_processed = old_file.size();
+    result.elapsed_seconds = std::chrono::duration<double>(end - start).count();
+    
+    if (callback) {
+        callback->on_complete(result);
+    }
+    return result;
+}
+
 Result apply_patch(
     const std::string& old_path,
     const std::string& patch_path,
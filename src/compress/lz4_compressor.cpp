@@ -71,6 +71,76 @@ std::vector<uint8_t> LZ4Compressor::compress(
 #endif
 }
 
+bool LZ4Compressor::decompress_to(
+    const uint8_t* data,
+    size_t size,
+    uint8_t* output,
+    size_t original_size
+) {
+    if (size == 0 || original_size == 0) {
+        return false;
+    }
+    
+#if BINDIFF_HAS_LZ4
+    int decompressed_size = LZ4_decompress_safe(
+        reinterpret_cast<const char*>(data),
+        reinterpret_cast<char*>(output),
+        static_cast<int>(size),
+        static_cast<int>(original_size)
+    );
+    return decompressed_size >= 0 && static_cast<size_t>(decompressed_size) == original_size;
+#else
+    // 无 LZ4 时数据原样存储
+    if (size != original_size) {
+        return false;
+    }
+    std::memcpy(output, data, size);
+    return true;
+#endif
+}
+
+size_t LZ4Compressor::compress_append(
+    const uint8_t* data,
+    size_t size,
+    std::vector<uint8_t>& output
+) {
+    if (size == 0) {
+        return 0;
+    }
+    
+#if BINDIFF_HAS_LZ4
+    // 直接压缩到 output 末尾
+    size_t start = output.size();
+    size_t bound = compress_bound(size);
+    output.resize(start + bound);
+    char* dst = reinterpret_cast<char*>(output.data() + start);
+    
+    int compressed_size;
+    if (level_ <= 3) {
+        compressed_size = LZ4_compress_default(
+            reinterpret_cast<const char*>(data), dst,
+            static_cast<int>(size), static_cast<int>(bound)
+        );
+    } else {
+        compressed_size = LZ4_compress_HC(
+            reinterpret_cast<const char*>(data), dst,
+            static_cast<int>(size), static_cast<int>(bound), level_
+        );
+    }
+    
+    if (compressed_size <= 0) {
+        output.resize(start);
+        return 0;
+    }
+    
+    output.resize(start + compressed_size);
+    return static_cast<size_t>(compressed_size);
+#else
+    output.insert(output.end(), data, data + size);
+    return size;
+#endif
+}
+
 std::vector<uint8_t> LZ4Compressor::decompress(
     const uint8_t* data, 
     size_t size,
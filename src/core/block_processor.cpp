@@ -1,18 +1,263 @@
 #include "core/block_processor.hpp"
 #include "core/matcher.hpp"
+#include "core/match_length.hpp"
 #include "compress/compressor.hpp"
 #include <algorithm>
+#include <cstddef>
 #include <cstring>
 
 namespace bindiff {
 
+namespace {
+
+// ============== 惰性匹配代价模型 ==============
+
+// 候选匹配 (已包含反向扩展): 新数据 [start, start + length) 复制自旧数据 old_offset
+struct MatchChoice {
+    size_t start;
+    size_t old_offset;
+    size_t length;
+    
+    size_t end() const { return start + length; }
+};
+
+// 估算从 insert_start 编码到 end 的序列化字节数:
+// 匹配之前的字节并入 INSERT；匹配之后到 end 的剩余部分不短于 min_match 时假定由另一个 COPY 覆盖，否则按 INSERT 计
+size_t encoding_cost(const MatchChoice& choice, size_t insert_start, size_t end, size_t min_match) {
+    static const size_t copy_cost = Operation::copy(0, 0).serialized_size();
+    static const size_t insert_cost = Operation::insert(nullptr, 0).serialized_size();
+    
+    size_t cost = copy_cost;
+    if (choice.start > insert_start) {
+        cost += insert_cost + (choice.start - insert_start);
+    }
+    size_t tail = end - choice.end();
+    if (tail >= min_match) {
+        cost += copy_cost;
+    } else if (tail > 0) {
+        cost += insert_cost + tail;
+    }
+    return cost;
+}
+
+// ============== 单字节重复 (FILL) ==============
+
+// 块内预先确定的区段: 整块锚点 (COPY) 或单字节重复 (FILL)
+struct FixedSegment {
+    size_t new_offset;
+    size_t length;
+    size_t old_offset;  // 锚点对应的旧数据偏移
+    bool fill;
+    byte value;         // FILL 的字节值
+};
+
+constexpr size_t FILL_PROBE = 32;     // 每隔 FILL_PROBE 字节检查一次，长度 >= 2 * FILL_PROBE - 1 的重复必被发现
+
+// 找出长度 >= MIN_FILL_LENGTH 的单字节重复，按偏移升序
+std::vector<FixedSegment> find_fills(const byte* data, size_t size) {
+    std::vector<FixedSegment> fills;
+    size_t covered = 0;
+    for (size_t i = 0; i + FILL_PROBE <= size; i += FILL_PROBE) {
+        if (i < covered) {
+            continue;
+        }
+        uint64_t pattern = data[i] * 0x0101010101010101ULL;
+        bool uniform = true;
+        for (size_t k = 0; k < FILL_PROBE; k += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i + k, 8);
+            uniform &= word == pattern;
+        }
+        if (!uniform) {
+            continue;
+        }
+        size_t start = i - match_length_backward(data + i, data + i + 1, i);
+        size_t end = i + 1 + match_length(data + i, data + i + 1, size - i - 1);
+        covered = end;
+        if (end - start >= MIN_FILL_LENGTH) {
+            fills.push_back({start, end - start, 0, true, data[i]});
+        }
+    }
+    return fills;
+}
+
+// 合并锚点与填充区段 (均按偏移升序)，与锚点重叠的填充以锚点为准
+std::vector<FixedSegment> merge_segments(const std::vector<ChunkAnchor>& anchors,
+                                         const std::vector<FixedSegment>& fills) {
+    std::vector<FixedSegment> segments;
+    segments.reserve(anchors.size() + fills.size());
+    size_t a = 0;
+    for (const auto& fill : fills) {
+        while (a < anchors.size() && anchors[a].new_offset + anchors[a].length <= fill.new_offset) {
+            const auto& anchor = anchors[a++];
+            segments.push_back({anchor.new_offset, anchor.length, anchor.old_offset, false, 0});
+        }
+        if (a < anchors.size() && anchors[a].new_offset < fill.new_offset + fill.length) {
+            continue;
+        }
+        segments.push_back(fill);
+    }
+    for (; a < anchors.size(); ++a) {
+        segments.push_back({anchors[a].new_offset, anchors[a].length, anchors[a].old_offset, false, 0});
+    }
+    return segments;
+}
+
+// ============== 块内重复 (COPY_NEW) ==============
+
+// 未匹配字节按开头 8 字节的哈希记录块内位置，每个哈希只保留最近一次 (单项哈希表，类似 LZ4)
+// 只记录 SELF_SAMPLE 对齐的位置、查询每个位置: 长度 >= min_match + SELF_SAMPLE - 1 的重复必被发现，
+// 表项少了 SELF_SAMPLE 倍，相距较远的重复不易被覆盖
+constexpr size_t SELF_SAMPLE = 8;
+constexpr unsigned SELF_MIN_HASH_BITS = 12;
+constexpr unsigned SELF_MAX_HASH_BITS = 22;
+constexpr uint64_t SELF_HASH_PRIME = 0x9E3779B185EBCA87ULL;
+
+inline size_t self_hash(const byte* p, unsigned bits) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    return static_cast<size_t>((word * SELF_HASH_PRIME) >> (64 - bits));
+}
+
+// ============== 近似匹配 (ADD) ==============
+
+// 与 bsdiff 相同的得分: 2 * 相同字节数 - 长度，即相同字节过半时为正
+// 差值中的 0 占多数，压缩后远小于拆成 COPY/INSERT/COPY 时的各个操作头
+constexpr ptrdiff_t ADD_MIN_SCORE = 32;      // 得分至少抵得上省下的操作头
+constexpr ptrdiff_t ADD_SLACK = 64;          // 得分比最高点低出这么多时停止扩展
+// 完全相同的区间达到此长度时留给 COPY: v2 下 COPY + INSERT 的操作头只有几个字节，
+// 与差值中同样长度的 0 经 LZ4 压缩后的大小相当
+constexpr size_t ADD_MAX_EXACT_RUN = 128;
+
+// 从对齐的 old_p / new_p 开始向后近似扩展 (不超过 limit)，返回得分最高处的长度，得分不足时返回 0
+size_t approximate_extension(const byte* old_p, const byte* new_p, size_t limit) {
+    size_t k = 0;
+    size_t matches = 0;
+    size_t best = 0;
+    ptrdiff_t best_score = 0;
+    while (k < limit) {
+        size_t run = match_length(old_p + k, new_p + k, limit - k);
+        if (run >= ADD_MAX_EXACT_RUN) {
+            break;
+        }
+        k += run;
+        matches += run;
+        ptrdiff_t score = 2 * static_cast<ptrdiff_t>(matches) - static_cast<ptrdiff_t>(k);
+        if (score > best_score) {
+            best_score = score;
+            best = k;
+        }
+        if (k == limit) {
+            break;
+        }
+        ++k;   // 不同的字节
+        if (score - 1 + ADD_SLACK < best_score) {
+            break;
+        }
+    }
+    return best_score >= ADD_MIN_SCORE ? best : 0;
+}
+
+// ============== 块数据的流 (v3) ==============
+
+// 编码缓冲区保留的容量上限: 几乎全是未匹配数据的块会让 literals 涨到块大小，
+// 编码完后释放超出的部分，线程池里每个线程不长期占着块大小量级的内存
+constexpr size_t MAX_RETAINED_ENCODE_CAPACITY = 16 * 1024 * 1024;
+
+// 编码缓冲区: 每个工作线程一份，逐块复用 (上限以内只清空不释放)，操作直接序列化进来，不经过中间的 Operation 数组
+struct EncodeBuffers {
+    OperationStreams streams;
+    std::vector<byte> diff;   // 当前 ADD 的差值
+    
+    // 块编码完后释放容量超出上限的缓冲区
+    void trim() {
+        for (auto* buffer : {&streams.control, &streams.literals, &streams.diffs, &diff}) {
+            if (buffer->capacity() > MAX_RETAINED_ENCODE_CAPACITY) {
+                std::vector<byte>().swap(*buffer);
+            }
+        }
+    }
+};
+
+EncodeBuffers& thread_encode_buffers() {
+    thread_local EncodeBuffers buffers;
+    buffers.streams.control.clear();
+    buffers.streams.literals.clear();
+    buffers.streams.diffs.clear();
+    return buffers;
+}
+
+// control 流只有操作码与变长整数，规律性强，用 LZ4HC 换更小的体积 (数据量小，耗时有限)
+constexpr int CONTROL_STREAM_LEVEL = 9;
+
+// 压缩 raw 并追加到 payload，压缩后不更小 (如已压缩的资源) 时原样存储，应用补丁时也省去解压
+StreamHeader append_stream(std::vector<uint8_t>& payload, const std::vector<byte>& raw, Compressor& compressor) {
+    StreamHeader header;
+    header.codec = static_cast<uint8_t>(CompressionType::None);
+    header.raw_size = static_cast<uint32_t>(raw.size());
+    header.stored_size = static_cast<uint32_t>(raw.size());
+    if (raw.empty()) {
+        return header;
+    }
+    // 直接压缩到 payload 末尾，不划算时回退为原样存储
+    size_t start = payload.size();
+    size_t stored = compressor.compress_append(raw.data(), raw.size(), payload);
+    if (stored > 0 && stored < raw.size()) {
+        header.codec = static_cast<uint8_t>(CompressionType::LZ4);
+        header.stored_size = static_cast<uint32_t>(stored);
+    } else {
+        payload.resize(start);
+        payload.insert(payload.end(), raw.begin(), raw.end());
+    }
+    return header;
+}
+
+// 解码缓冲区: 每个线程一份，只增不减，逐块复用 (不再每块分配并清零)
+struct DecodeBuffers {
+    std::vector<uint8_t> streams[BLOCK_STREAM_COUNT];
+};
+
+DecodeBuffers& thread_decode_buffers() {
+    thread_local DecodeBuffers buffers;
+    return buffers;
+}
+
+// 保证 buffer 至少有 size 字节，返回起始地址
+uint8_t* grow_buffer(std::vector<uint8_t>& buffer, size_t size) {
+    if (buffer.size() < size) {
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+// 取出一个流: 原样存储的直接指向块数据，压缩的解压到 buffer
+const byte* unpack_stream(const StreamHeader& header, const uint8_t* stored, Compressor& compressor,
+                          std::vector<uint8_t>& buffer) {
+    if (header.codec == static_cast<uint8_t>(CompressionType::None)) {
+        return header.raw_size == header.stored_size ? stored : nullptr;
+    }
+    if (header.codec != static_cast<uint8_t>(CompressionType::LZ4) || header.raw_size == 0) {
+        return nullptr;
+    }
+    uint8_t* target = grow_buffer(buffer, header.raw_size);
+    return compressor.decompress_to(stored, header.stored_size, target, header.raw_size) ? target : nullptr;
+}
+
+} // namespace
+
 // ============== BlockProcessor 实现 ==============
 
-BlockProcessor::BlockProcessor(uint32_t block_size, int compression_level)
+BlockProcessor::BlockProcessor(uint32_t block_size, int compression_level, uint32_t lazy_lookahead,
+                               bool self_copy, bool delta_add)
     : block_size_(block_size)
     , compression_level_(compression_level)
+    , lazy_lookahead_(lazy_lookahead)
+    , self_copy_(self_copy)
+    , delta_add_(delta_add)
 {
     compressor_ = std::make_unique<LZ4Compressor>(compression_level);
+    control_compressor_ = std::make_unique<LZ4Compressor>(std::max(compression_level, CONTROL_STREAM_LEVEL));
+    diff_compressor_ = std::make_unique<LZ4Compressor>(1);
 }
 
 BlockProcessor::~BlockProcessor() = default;
@@ -21,7 +266,8 @@ BlockResult BlockProcessor::process_block(
     uint32_t block_index,
     const byte* old_data, size_t old_size,
     const byte* new_data, size_t new_size,
-    const BlockMatcher* global_matcher
+    const BlockMatcher* global_matcher,
+    const std::vector<ChunkAnchor>& anchors
 ) {
     BlockResult result;
     result.block_index = block_index;
@@ -33,91 +279,262 @@ BlockResult BlockProcessor::process_block(
     }
     
     // 使用全局匹配器或创建本地匹配器
-    BlockMatcher* matcher = nullptr;
+    // 全局匹配器由所有工作线程共享，只通过各自的 MatchCursor 读取
+    const BlockMatcher* matcher = global_matcher;
     std::unique_ptr<BlockMatcher> local_matcher;
     
-    if (global_matcher) {
-        matcher = const_cast<BlockMatcher*>(global_matcher);
-    } else {
+    if (!matcher) {
         // 降级：创建本地索引（性能较差）
-        local_matcher = std::make_unique<BlockMatcher>(32);
-        local_matcher->build_index(old_data, old_size, 32);
+        local_matcher = std::make_unique<BlockMatcher>(MIN_MATCH_LENGTH);
+        local_matcher->build_index(old_data, old_size, MIN_MATCH_LENGTH);
         matcher = local_matcher.get();
     }
     
-    // 生成操作
-    std::vector<Operation> operations;
+    MatchCursor cursor(*matcher, old_data, old_size, new_data, new_size);
+    return encode_block(block_index, old_data, old_size, new_data, new_size, cursor, matcher->min_match(), anchors);
+}
+
+BlockResult BlockProcessor::process_block(
+    uint32_t block_index,
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    const SuffixMatcher& suffix_matcher,
+    const std::vector<ChunkAnchor>& anchors
+) {
+    if (new_size == 0) {
+        BlockResult result;
+        result.block_index = block_index;
+        result.success = true;
+        result.original_size = 0;
+        return result;
+    }
+    
+    SuffixCursor cursor(suffix_matcher, old_data, old_size, new_data, new_size);
+    return encode_block(block_index, old_data, old_size, new_data, new_size, cursor, suffix_matcher.min_match(),
+                        anchors);
+}
+
+template <typename Cursor>
+BlockResult BlockProcessor::encode_block(
+    uint32_t block_index,
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    Cursor& cursor,
+    size_t min_match,
+    const std::vector<ChunkAnchor>& anchors
+) {
+    BlockResult result;
+    result.block_index = block_index;
     
-    size_t pos = 0;
-    while (pos < new_size) {
-        // 尝试找到匹配
-        auto match = matcher->find_longest_match(
-            old_data, old_size,
-            new_data, new_size,
-            pos
+    // 操作生成后立即序列化；INSERT 只引用 new_data，不复制
+    EncodeBuffers& buffers = thread_encode_buffers();
+    OperationStreams& streams = buffers.streams;
+    OperationContext context;
+    auto emit = [&](const Operation& op) {
+        OperationSerializer::serialize(op, context, streams);
+    };
+    
+    size_t insert_start = 0;  // 尚未输出的 INSERT 区间起点
+    
+    // 反向扩展: 待输出 INSERT 的尾部若与旧数据吻合则并入 COPY
+    auto extend_backward = [&](size_t pos, size_t old_offset, size_t length) {
+        size_t back = match_length_backward(
+            old_data + old_offset, new_data + pos,
+            std::min(old_offset, pos - insert_start)
         );
-        
-        if (match.valid() && match.length >= 32) {
-            // 找到匹配，生成 COPY 操作
-            operations.push_back(Operation::copy(match.old_offset, static_cast<uint32_t>(match.length)));
-            pos += match.length;
-        } else {
-            // 没有匹配，收集未匹配字节生成 INSERT
-            size_t insert_start = pos;
-            size_t insert_end = pos + 1;
-            
-            // 继续查找下一个匹配点
-            // 动态调整搜索窗口：对于大数据块，增大搜索步长
-            size_t search_window = std::min(
-                static_cast<size_t>(4096),  // 最多向前搜索 4KB
-                std::max(
-                    static_cast<size_t>(256),  // 至少 256 字节
-                    new_size / 1000            // 或 0.1% 的新文件大小
-                )
-            );
-            size_t max_search = std::min(pos + search_window, new_size);
-            while (insert_end < max_search) {
-                auto next_match = matcher->find_longest_match(
-                    old_data, old_size,
-                    new_data, new_size,
-                    insert_end
-                );
-                
-                if (next_match.valid() && next_match.length >= 32) {
-                    break;  // 找到下一个匹配，停止收集
-                }
-                ++insert_end;
+        return MatchChoice{pos - back, old_offset - back, length + back};
+    };
+    
+    // 输出 [begin, end) 的未匹配字节: 与本块已输出内容重复的部分 (不短于 min_match) 为 COPY_NEW，
+    // 其余为 INSERT。哈希表只记录未匹配字节的位置，旧数据中有的内容已由 COPY 覆盖
+    // (哈希取开头 8 字节，长度下限至少为 8)
+    const size_t self_min = std::max(min_match, sizeof(uint64_t));
+    std::vector<uint32_t> self_table;   // 位置 + 1，0 表示空
+    unsigned self_bits = SELF_MIN_HASH_BITS;
+    while (self_bits < SELF_MAX_HASH_BITS && (size_t(1) << self_bits) < new_size / SELF_SAMPLE) {
+        ++self_bits;
+    }
+    auto emit_literals = [&](size_t begin, size_t end) {
+        size_t literal_start = begin;
+        if (self_copy_ && end - begin >= self_min) {
+            if (self_table.empty()) {
+                self_table.assign(size_t(1) << self_bits, 0);
             }
-            
-            // 如果到达搜索上限仍未找到，直接到末尾
-            if (insert_end == max_search && max_search < new_size) {
-                insert_end = new_size;
+            size_t pos = begin;
+            while (pos + self_min <= end) {
+                uint32_t& slot = self_table[self_hash(new_data + pos, self_bits)];
+                size_t candidate = slot;
+                if (pos % SELF_SAMPLE == 0) {
+                    slot = static_cast<uint32_t>(pos + 1);
+                }
+                if (candidate > 0) {
+                    // 来源不与当前位置重叠，重建时可直接 memcpy
+                    size_t source = candidate - 1;
+                    size_t length = match_length(new_data + source, new_data + pos,
+                                                 std::min(end - pos, pos - source));
+                    if (length >= self_min) {
+                        // 向前扩展到本段未输出的字节 (采样使匹配可能晚几个字节才被发现)
+                        // 来源与当前位置的间距不变，总长仍不能超过间距 (周期性数据的匹配可以一直延伸)
+                        size_t back = match_length_backward(new_data + source, new_data + pos,
+                                                            std::min(source, pos - literal_start));
+                        source -= back;
+                        pos -= back;
+                        length = std::min(length + back, pos - source);
+                        if (pos > literal_start) {
+                            emit(Operation::insert(new_data + literal_start, pos - literal_start));
+                        }
+                        emit(Operation::copy_new(static_cast<uint32_t>(source),
+                                                 static_cast<uint32_t>(length)));
+                        pos += length;
+                        literal_start = pos;
+                        continue;
+                    }
+                }
+                ++pos;
             }
-            
-            // 生成 INSERT 操作
-            size_t insert_size = insert_end - insert_start;
-            operations.push_back(Operation::insert(new_data + insert_start, insert_size));
-            pos = insert_end;
         }
-    }
+        if (end > literal_start) {
+            emit(Operation::insert(new_data + literal_start, end - literal_start));
+        }
+    };
+    
+    // 输出 COPY 及其之前的未匹配字节
+    auto emit_copy = [&](const MatchChoice& choice) {
+        if (choice.start > insert_start) {
+            emit_literals(insert_start, choice.start);
+        }
+        emit(Operation::copy(choice.old_offset, static_cast<uint32_t>(choice.length)));
+        insert_start = choice.end();
+    };
+    
+    // 刚输出的 COPY 止于旧数据 old_end: 其后到 limit 之间相同字节占多数时输出 ADD，
+    // 零星改动 (版本号、头部偏移、GUID 等) 不再把匹配拆成 COPY/INSERT/COPY
+    auto emit_add = [&](size_t old_end, size_t limit) {
+        if (!delta_add_ || insert_start >= limit || old_end >= old_size) {
+            return;
+        }
+        size_t length = approximate_extension(old_data + old_end, new_data + insert_start,
+                                              std::min(limit - insert_start, old_size - old_end));
+        if (length > 0) {
+            buffers.diff.resize(length);
+            Operation::compute_diff(old_data + old_end, new_data + insert_start, length, buffers.diff.data());
+            emit(Operation::add(old_end, buffers.diff.data(), length));
+            insert_start += length;
+        }
+    };
     
-    // 序列化操作
-    std::vector<byte> serialized;
-    OperationSerializer::serialize_all(operations, serialized);
+    // 输出 FILL 及其之前的未匹配字节
+    auto emit_fill = [&](size_t pos, byte value, size_t length) {
+        if (pos > insert_start) {
+            emit_literals(insert_start, pos);
+        }
+        emit(Operation::fill(value, static_cast<uint32_t>(length)));
+        insert_start = pos + length;
+    };
     
-    // 保存原始大小
-    result.original_size = static_cast<uint32_t>(serialized.size());
+    // 惰性匹配: 在 pos 之后 lazy_lookahead_ 个位置内寻找编码代价更低的匹配 (类似 zlib 的 lazy match)
+    // 两个候选比较时都计算到二者中较远的终点，使代价覆盖同一区间
+    auto select_lazy = [&](MatchChoice best, size_t pos, size_t gap_end) {
+        size_t limit = std::min(gap_end, pos + 1 + lazy_lookahead_);
+        for (size_t next = pos + 1; next < limit; ++next) {
+            cursor.seek(next);
+            if (!cursor.has_window()) {
+                break;
+            }
+            auto match = cursor.find();
+            if (!match.valid() || next + match.length <= best.end()) {
+                continue;
+            }
+            auto candidate = extend_backward(next, match.old_offset, match.length);
+            size_t end = candidate.end();
+            if (encoding_cost(candidate, insert_start, end, min_match) <
+                encoding_cost(best, insert_start, end, min_match)) {
+                best = candidate;
+            }
+        }
+        return best;
+    };
+    
+    // 整块锚点与单字节重复直接输出，只在它们之间的空隙中滚动扫描 (都没有时空隙即整个块)
+    // 空隙中找到的 COPY 若已越过重复区段则以 COPY 为准，不拆开连续的匹配
+    auto segments = merge_segments(anchors, find_fills(new_data, new_size));
+    size_t next_segment = 0;
+    while (true) {
+        // 跳过已被前面的 COPY 完全覆盖的区段
+        while (next_segment < segments.size() &&
+               segments[next_segment].new_offset + segments[next_segment].length <= insert_start) {
+            ++next_segment;
+        }
+        size_t gap_end = next_segment < segments.size() ? segments[next_segment].new_offset : new_size;
+        
+        // 在空隙中扫描，只在找到候选时停下验证
+        cursor.seek(insert_start);
+        while (insert_start < gap_end && cursor.has_window()) {
+            auto match = cursor.scan(gap_end);
+            if (!match.valid()) {
+                break;
+            }
+            size_t pos = cursor.position();
+            auto choice = extend_backward(pos, match.old_offset, match.length);
+            if (lazy_lookahead_ > 0) {
+                choice = select_lazy(choice, pos, gap_end);
+            }
+            emit_copy(choice);
+            emit_add(choice.old_offset + choice.length, gap_end);
+            cursor.seek(insert_start);
+        }
+        
+        if (next_segment == segments.size()) {
+            break;
+        }
+        
+        // 输出区段 (开头可能已被空隙中的匹配覆盖)
+        const auto& segment = segments[next_segment++];
+        if (segment.new_offset + segment.length <= insert_start) {
+            continue;
+        }
+        size_t skip = insert_start > segment.new_offset ? insert_start - segment.new_offset : 0;
+        size_t pos = segment.new_offset + skip;
+        if (segment.fill) {
+            // 剩余部分过短时留给下一个空隙按普通数据处理
+            if (segment.length - skip >= MIN_FILL_LENGTH) {
+                emit_fill(pos, segment.value, segment.length - skip);
+            }
+        } else {
+            // 锚点向后扩展到实际匹配终点
+            size_t old_offset = segment.old_offset + skip;
+            size_t length = segment.length - skip;
+            length += match_length(
+                old_data + old_offset + length, new_data + pos + length,
+                std::min(old_size - old_offset - length, new_size - pos - length)
+            );
+            emit_copy(extend_backward(pos, old_offset, length));
+            emit_add(old_offset + length,
+                     next_segment < segments.size() ? segments[next_segment].new_offset : new_size);
+        }
+    }
     
-    // 压缩（移动语义，避免拷贝）
-    if (serialized.size() > 0) {
-        result.data = compressor_->compress(serialized.data(), serialized.size());
+    // 剩余的未匹配字节
+    if (insert_start < new_size) {
+        emit_literals(insert_start, new_size);
     }
     
-    // 清空临时数据，减少内存占用
-    operations.clear();
-    operations.shrink_to_fit();
-    serialized.clear();
-    serialized.shrink_to_fit();
+    // 保存原始大小 (三个流之和)
+    result.original_size = static_cast<uint32_t>(
+        streams.control.size() + streams.literals.size() + streams.diffs.size());
+    
+    // 各流分别压缩: control 用 LZ4HC，literals 用设定的级别，diffs (以 0 为主) 用快速模式
+    std::vector<uint8_t> payload(BLOCK_STREAM_COUNT * StreamHeader::SIZE);
+    StreamHeader headers[BLOCK_STREAM_COUNT] = {
+        append_stream(payload, streams.control, *control_compressor_),
+        append_stream(payload, streams.literals, *compressor_),
+        append_stream(payload, streams.diffs, *diff_compressor_),
+    };
+    std::memcpy(payload.data(), headers, sizeof(headers));
+    buffers.trim();
+    // 结果在写出补丁前一直保留，释放压缩预留的多余容量
+    payload.shrink_to_fit();
+    result.data = std::move(payload);
     
     result.success = true;
     return result;
@@ -126,36 +543,72 @@ BlockResult BlockProcessor::process_block(
 bool BlockProcessor::reconstruct_block(
     uint32_t /*block_index*/,
     const byte* old_data, size_t old_size,
-    const std::vector<uint8_t>& compressed_data,
+    const uint8_t* compressed_data, size_t compressed_size,
     uint32_t original_size,
-    byte* output, size_t output_size
+    byte* output, size_t output_size,
+    std::vector<ByteRange>* zero_fills,
+    uint16_t format_version,
+    bool output_zeroed
 ) {
-    if (compressed_data.empty()) {
+    if (compressed_size == 0) {
         return output_size == 0;
     }
     
-    // 解压
-    auto decompressed = compressor_->decompress(
-        compressed_data.data(),
-        compressed_data.size(),
-        original_size
-    );
+    // v1 / v2: 整个操作流一起压缩；v3: 按流头取出三个流
+    DecodeBuffers& buffers = thread_decode_buffers();
+    const byte* control = nullptr;
+    size_t control_size = 0;
+    StreamCursor literals;
+    StreamCursor diffs;
     
-    if (decompressed.empty() && original_size > 0) {
-        return false;
+    if (format_version >= OP_FORMAT_V3) {
+        if (compressed_size < BLOCK_STREAM_COUNT * StreamHeader::SIZE) {
+            return false;
+        }
+        StreamHeader headers[BLOCK_STREAM_COUNT];
+        std::memcpy(headers, compressed_data, sizeof(headers));
+        
+        const byte* streams[BLOCK_STREAM_COUNT];
+        size_t offset = sizeof(headers);
+        for (size_t s = 0; s < BLOCK_STREAM_COUNT; ++s) {
+            if (compressed_size - offset < headers[s].stored_size) {
+                return false;
+            }
+            streams[s] = unpack_stream(headers[s], compressed_data + offset, *compressor_, buffers.streams[s]);
+            if (!streams[s] && headers[s].raw_size > 0) {
+                return false;
+            }
+            offset += headers[s].stored_size;
+        }
+        control = streams[0];
+        control_size = headers[0].raw_size;
+        literals = {streams[1], headers[1].raw_size, 0};
+        diffs = {streams[2], headers[2].raw_size, 0};
+    } else {
+        control = grow_buffer(buffers.streams[0], original_size);
+        control_size = original_size;
+        if (original_size > 0 &&
+            !compressor_->decompress_to(compressed_data, compressed_size,
+                                        buffers.streams[0].data(), original_size)) {
+            return false;
+        }
     }
     
-    // 解析并执行操作
+    // 单遍解析并执行: 操作在栈上解码，INSERT / ADD 的数据直接从流中读取
     size_t pos = 0;
     size_t output_pos = 0;
+    OperationContext context;
     
-    while (pos < decompressed.size() && output_pos < output_size) {
+    while (pos < control_size && output_pos < output_size) {
         Operation op;
-        size_t read = OperationSerializer::deserialize(
-            decompressed.data() + pos,
-            decompressed.size() - pos,
-            op
-        );
+        size_t read;
+        if (format_version == OP_FORMAT_V1) {
+            read = OperationSerializer::deserialize(control + pos, control_size - pos, op);
+        } else if (format_version == OP_FORMAT_V2) {
+            read = OperationSerializer::deserialize(control + pos, control_size - pos, op, context);
+        } else {
+            read = OperationSerializer::deserialize(control + pos, control_size - pos, op, context, literals, diffs);
+        }
         
         if (read == 0) break;
         pos += read;
@@ -163,18 +616,52 @@ bool BlockProcessor::reconstruct_block(
         if (op.opcode == OpCode::COPY) {
             // 从原文件复制
             if (op.copy_offset >= old_size || 
-                op.copy_offset + op.copy_length > old_size) {
+                op.copy_offset + op.copy_length > old_size ||
+                output_pos + op.copy_length > output_size) {
                 return false;
             }
             std::memcpy(output + output_pos, old_data + op.copy_offset, op.copy_length);
             output_pos += op.copy_length;
+        } else if (op.opcode == OpCode::COPY_NEW) {
+            // 从本块已重建的部分复制，来源必须完整位于当前位置之前
+            if (op.copy_offset + op.copy_length > output_pos ||
+                output_pos + op.copy_length > output_size) {
+                return false;
+            }
+            std::memcpy(output + output_pos, output + op.copy_offset, op.copy_length);
+            output_pos += op.copy_length;
+        } else if (op.opcode == OpCode::ADD) {
+            // 旧文件字节加上差值
+            if (op.copy_offset >= old_size ||
+                op.copy_offset + op.copy_length > old_size ||
+                output_pos + op.copy_length > output_size) {
+                return false;
+            }
+            const byte* source = old_data + op.copy_offset;
+            const byte* diff = op.data;
+            byte* target = output + output_pos;
+            for (uint32_t i = 0; i < op.copy_length; ++i) {
+                target[i] = static_cast<byte>(source[i] + diff[i]);
+            }
+            output_pos += op.copy_length;
+        } else if (op.opcode == OpCode::FILL) {
+            if (output_pos + op.fill_length > output_size) {
+                return false;
+            }
+            if (op.fill_value != 0 || !output_zeroed) {
+                std::memset(output + output_pos, op.fill_value, op.fill_length);
+            }
+            if (zero_fills && op.fill_value == 0) {
+                zero_fills->push_back({output_pos, op.fill_length});
+            }
+            output_pos += op.fill_length;
         } else {
             // 插入新数据
-            if (output_pos + op.insert_data.size() > output_size) {
+            if (output_pos + op.data_length > output_size) {
                 return false;
             }
-            std::memcpy(output + output_pos, op.insert_data.data(), op.insert_data.size());
-            output_pos += op.insert_data.size();
+            std::memcpy(output + output_pos, op.data, op.data_length);
+            output_pos += op.data_length;
         }
     }
     
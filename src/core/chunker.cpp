@@ -0,0 +1,234 @@
+#include "core/chunker.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace bindiff {
+
+namespace {
+
+// ============== 指纹 (XXH64 算法) ==============
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t read64(const byte* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t read32(const byte* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = detail::rotl64(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+// 在 [min_size, max_size] 内寻找下一个分块边界，返回块长度
+size_t next_boundary(const byte* data, size_t size, const ChunkerParams& params,
+                     uint64_t mask_small, uint64_t mask_large) {
+    if (size <= params.min_size) {
+        return size;
+    }
+    size_t limit = std::min<size_t>(size, params.max_size);
+    size_t normal = std::min<size_t>(limit, params.avg_size);
+
+    // Gear 哈希: 每字节左移一位，高位由最近 64 字节决定
+    // 平均长度之前用更严格的掩码，之后用更宽松的掩码，使块长集中在平均值附近
+    const auto& gear = detail::BUZ_TABLE.values;
+    uint64_t fp = 0;
+    size_t i = params.min_size;
+    for (; i < normal; ++i) {
+        fp = (fp << 1) + gear[data[i]];
+        if ((fp & mask_small) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; ++i) {
+        fp = (fp << 1) + gear[data[i]];
+        if ((fp & mask_large) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+// 取高 bits 位的掩码
+inline uint64_t high_mask(unsigned bits) {
+    return bits == 0 ? 0 : ~uint64_t(0) << (64 - bits);
+}
+
+} // namespace
+
+uint64_t chunk_fingerprint(const byte* data, size_t size) {
+    const byte* p = data;
+    const byte* end = data + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = PRIME1 + PRIME2;
+        uint64_t v2 = PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - PRIME1;
+        const byte* limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = detail::rotl64(v1, 1) + detail::rotl64(v2, 7) + detail::rotl64(v3, 12) + detail::rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = PRIME5;
+    }
+
+    h += static_cast<uint64_t>(size);
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = detail::rotl64(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = detail::rotl64(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * PRIME5;
+        h = detail::rotl64(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::vector<Chunk> chunk_data(const byte* data, size_t size, const ChunkerParams& params) {
+    std::vector<Chunk> chunks;
+    if (size == 0) {
+        return chunks;
+    }
+    chunks.reserve(size / params.avg_size + 1);
+
+    unsigned bits = 0;
+    while ((uint32_t(1) << (bits + 1)) <= params.avg_size) {
+        ++bits;
+    }
+    uint64_t mask_small = high_mask(bits + 2);
+    uint64_t mask_large = high_mask(bits >= 2 ? bits - 2 : 0);
+
+    size_t offset = 0;
+    while (offset < size) {
+        size_t length = next_boundary(data + offset, size - offset, params, mask_small, mask_large);
+        chunks.push_back({offset, static_cast<uint32_t>(length), chunk_fingerprint(data + offset, length)});
+        offset += length;
+    }
+    return chunks;
+}
+
+// ============== 整块匹配 ==============
+
+std::vector<ChunkAnchor> match_chunks(
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    const ChunkerParams& params
+) {
+    // 两个文件的分块互不依赖，并行进行
+    std::vector<Chunk> old_chunks;
+    std::thread old_thread([&]() {
+        old_chunks = chunk_data(old_data, old_size, params);
+    });
+    std::vector<Chunk> new_chunks = chunk_data(new_data, new_size, params);
+    old_thread.join();
+
+    // 旧块按 (指纹, 偏移) 排序，相同内容优先取靠前的位置
+    std::sort(old_chunks.begin(), old_chunks.end(), [](const Chunk& a, const Chunk& b) {
+        return a.fingerprint != b.fingerprint ? a.fingerprint < b.fingerprint : a.offset < b.offset;
+    });
+
+    std::vector<ChunkAnchor> anchors;
+    for (const auto& chunk : new_chunks) {
+        auto it = std::lower_bound(old_chunks.begin(), old_chunks.end(), chunk.fingerprint,
+            [](const Chunk& c, uint64_t fp) { return c.fingerprint < fp; });
+
+        // 指纹相同时逐字节确认；优先选择能与上一个锚点连续的候选
+        const Chunk* found = nullptr;
+        for (; it != old_chunks.end() && it->fingerprint == chunk.fingerprint; ++it) {
+            if (it->length != chunk.length ||
+                std::memcmp(old_data + it->offset, new_data + chunk.offset, chunk.length) != 0) {
+                continue;
+            }
+            if (!found) {
+                found = &*it;
+            }
+            if (!anchors.empty() &&
+                anchors.back().new_offset + anchors.back().length == chunk.offset &&
+                anchors.back().old_offset + anchors.back().length == it->offset) {
+                found = &*it;
+                break;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+
+        if (!anchors.empty() &&
+            anchors.back().new_offset + anchors.back().length == chunk.offset &&
+            anchors.back().old_offset + anchors.back().length == found->offset) {
+            anchors.back().length += chunk.length;
+        } else {
+            anchors.push_back({chunk.offset, found->offset, chunk.length});
+        }
+    }
+    return anchors;
+}
+
+std::vector<ByteRange> anchor_old_ranges(const std::vector<ChunkAnchor>& anchors) {
+    std::vector<ByteRange> ranges;
+    ranges.reserve(anchors.size());
+    for (const auto& anchor : anchors) {
+        ranges.push_back({anchor.old_offset, anchor.length});
+    }
+    return ranges;
+}
+
+std::vector<ChunkAnchor> anchors_in_range(
+    const std::vector<ChunkAnchor>& anchors,
+    uint64_t begin, uint64_t end
+) {
+    std::vector<ChunkAnchor> result;
+    auto it = std::lower_bound(anchors.begin(), anchors.end(), begin,
+        [](const ChunkAnchor& a, uint64_t pos) { return a.new_offset + a.length <= pos; });
+
+    for (; it != anchors.end() && it->new_offset < end; ++it) {
+        uint64_t first = std::max(it->new_offset, begin);
+        uint64_t last = std::min(it->new_offset + it->length, end);
+        result.push_back({first - begin, it->old_offset + (first - it->new_offset), last - first});
+    }
+    return result;
+}
+
+} // namespace bindiff
@@ -1,19 +1,65 @@
 #include "core/diff_engine.hpp"
+#include "core/index_file.hpp"
 #include "core/matcher.hpp"
 #include "core/patch_format.hpp"
+#include "io/async_file.hpp"
 #include "io/stream_writer.hpp"
 #include "crypto/sha256.hpp"
 #include <algorithm>
 #include <chrono>
 #include <cstring>
-#include <fstream>
+#include <thread>
 
 namespace bindiff {
 
+namespace {
+
+// ============== 压缩等级预设 ==============
+
+struct EffortPreset {
+    MatcherParams matcher;
+    int compression_level;
+    uint32_t lazy_lookahead;
+    bool self_copy;
+    bool delta_add;
+};
+
+// 低等级增大采样步长、减少候选验证，并关闭块内复制与近似匹配；高等级加密采样、放宽候选上限并启用惰性匹配
+// 5 级与各项默认值相同
+const EffortPreset EFFORT_PRESETS[MAX_EFFORT] = {
+    // min_match, 步长 >100MB, 步长 >1GB, 条目上限, 候选数, 提前退出, 无索引提前退出 | LZ4 级别, 惰性匹配, 块内复制, 近似匹配
+    {{64, 16, 32, size_t(1) << 25,   16,   256,  256},  1, 0, false, false},
+    {{48, 12, 24, size_t(1) << 26,   32,   512,  512},  1, 0, true,  false},
+    {{40,  8, 16, size_t(1) << 26,   64,  1024,  512},  1, 0, true,  true},
+    {{32,  6, 12, size_t(1) << 27,  128,  2048, 1024},  1, 0, true,  true},
+    {{32,  4,  8, size_t(1) << 27,  200,  4096, 1024},  1, 0, true,  true},
+    {{32,  4,  8, size_t(1) << 27,  400,  8192, 2048},  3, 1, true,  true},
+    {{32,  2,  4, size_t(1) << 27,  600, 16384, 4096},  6, 2, true,  true},
+    {{32,  2,  4, size_t(1) << 28, 1000, 32768, 8192},  9, 4, true,  true},
+    {{24,  1,  2, size_t(1) << 28, 2000, 65536, 16384}, 12, 8, true,  true},
+};
+
+} // namespace
+
+DiffOptions resolve_effort(const DiffOptions& options) {
+    DiffOptions resolved = options;
+    if (options.effort >= MIN_EFFORT && options.effort <= MAX_EFFORT) {
+        const auto& preset = EFFORT_PRESETS[options.effort - 1];
+        // 采样方式不属于预设，保留调用方的 winnowing 设置
+        resolved.matcher = preset.matcher;
+        resolved.matcher.winnow_guarantee = options.matcher.winnow_guarantee;
+        resolved.compression_level = preset.compression_level;
+        resolved.lazy_lookahead = preset.lazy_lookahead;
+        resolved.self_copy = preset.self_copy;
+        resolved.delta_add = preset.delta_add;
+    }
+    return resolved;
+}
+
 // ============== DiffEngine 实现 ==============
 
 DiffEngine::DiffEngine(const DiffOptions& options)
-    : options_(options)
+    : options_(resolve_effort(options))
 {
 }
 
@@ -33,6 +79,10 @@ Result DiffEngine::create_diff(
         result.error = "原文件不存在: " + old_path;
         return result;
     }
+    if (!options_.index_path.empty() && options_.match_mode == MatchMode::SuffixArray) {
+        result.error = "预建索引只能用于哈希匹配模式";
+        return result;
+    }
     if (!file_exists(new_path)) {
         result.error = "新文件不存在: " + new_path;
         return result;
@@ -69,11 +119,19 @@ Result DiffEngine::create_diff(
     // 4. 初始化线程池
     init_thread_pool();
     
-    // 5. 并行构建全局索引
+    // 5. 内容定义分块，匹配整块内容
+    anchors_.clear();
+    if (options_.chunk_matching) {
+        if (callback) {
+            callback->on_progress(0.35f, "内容分块匹配");
+        }
+        anchors_ = match_chunks(old_file.data(), old_file.size(), new_file.data(), new_file.size());
+    }
+    
+    // 6. 并行构建全局索引
     if (callback) {
         callback->on_progress(0.35f, "构建全局索引");
     }
-    global_matcher_ = std::make_unique<BlockMatcher>(32);
     
     // 使用与线程池相同的线程数
     int index_threads = options_.num_threads;
@@ -81,13 +139,47 @@ Result DiffEngine::create_diff(
         index_threads = static_cast<int>(std::thread::hardware_concurrency());
         if (index_threads <= 0) index_threads = 4;
     }
-    global_matcher_->build_index_parallel(old_file.data(), old_file.size(), 32, index_threads);
+    if (options_.match_mode == MatchMode::SuffixArray) {
+        global_matcher_.reset();
+        suffix_matcher_ = std::make_unique<SuffixMatcher>(options_.matcher.min_match);
+        suffix_matcher_->build(old_file.data(), old_file.size(), index_threads);
+    } else if (!options_.index_path.empty()) {
+        // 预先构建的索引: 映射后直接使用，跳过构建
+        suffix_matcher_.reset();
+        global_matcher_ = std::make_unique<BlockMatcher>(options_.matcher);
+        std::string error;
+        if (!load_index_file(options_.index_path, *global_matcher_, old_path, old_file.size(),
+                             options_.verify ? &old_hash : nullptr, error)) {
+            result.error = error;
+            return result;
+        }
+    } else {
+        suffix_matcher_.reset();
+        global_matcher_ = std::make_unique<BlockMatcher>(options_.matcher);
+        // 已被整块匹配的旧数据不再进入细粒度索引，索引规模随改动量而非文件大小增长
+        global_matcher_->build_index_parallel(old_file.data(), old_file.size(), options_.matcher.min_match,
+                                              index_threads, anchor_old_ranges(anchors_));
+    }
+    
+    // 新文件索引的条目由各块的处理任务顺带收集 (按块分段)，块数据此时正在缓存中
+    std::unique_ptr<BlockMatcher> new_matcher;
+    std::unique_ptr<IndexBuilder> new_index;
+    if (!options_.emit_index_path.empty()) {
+        new_matcher = std::make_unique<BlockMatcher>(options_.matcher);
+        new_index = std::make_unique<IndexBuilder>(*new_matcher, new_file.data(), new_file.size(),
+                                                   options_.matcher.min_match, options_.block_size,
+                                                   index_threads);
+    }
     
-    // 6. 分块处理
+    // 7. 分块处理
     if (callback) {
         callback->on_progress(0.4f, "分析文件差异");
     }
-    auto blocks = process_all_blocks(old_file, new_file, callback);
+    auto blocks = process_all_blocks(old_file, new_file, new_index.get(), callback);
+    if (new_index) {
+        new_index->finish();
+        new_index.reset();
+    }
     
     // 检查是否所有块都成功
     for (const auto& block : blocks) {
@@ -97,15 +189,28 @@ Result DiffEngine::create_diff(
         }
     }
     
-    // 6. 写入 patch 文件
+    // 8. 写入 patch 文件
     if (callback) {
         callback->on_progress(0.9f, "写入补丁文件");
     }
-    if (!write_patch_file(patch_path, old_file, new_file, blocks, old_hash, new_hash)) {
-        result.error = "写入补丁文件失败";
+    std::string write_error;
+    if (!write_patch_file(patch_path, old_file, new_file, blocks, old_hash, new_hash, write_error)) {
+        result.error = "写入补丁文件失败: " + write_error;
         return result;
     }
     
+    if (new_matcher) {
+        if (callback) {
+            callback->on_progress(0.95f, "写入新文件索引");
+        }
+        std::string error;
+        if (!save_index_file(options_.emit_index_path, *new_matcher, new_path, new_file.size(),
+                             options_.verify ? &new_hash : nullptr, error)) {
+            result.error = error;
+            return result;
+        }
+    }
+    
     auto end = std::chrono::high_resolution_clock::now();
     result.success = true;
     result.bytes_processed = new_file.size();
@@ -125,12 +230,15 @@ void DiffEngine::init_thread_pool() {
         if (threads <= 0) threads = 4;
     }
     thread_pool_ = std::make_unique<ThreadPool>(threads);
-    block_processor_ = std::make_unique<BlockProcessor>(options_.block_size, options_.compression_level);
+    block_processor_ = std::make_unique<BlockProcessor>(
+        options_.block_size, options_.compression_level, options_.lazy_lookahead, options_.self_copy,
+        options_.delta_add);
 }
 
 std::vector<BlockResult> DiffEngine::process_all_blocks(
     MMapFile& old_file,
     MMapFile& new_file,
+    IndexBuilder* new_index,
     ProgressCallback* callback
 ) {
     uint64_t new_size = new_file.size();
@@ -149,18 +257,33 @@ std::vector<BlockResult> DiffEngine::process_all_blocks(
         uint64_t end = std::min(start + options_.block_size, new_size);
         uint64_t block_size = end - start;
         
-        futures.push_back(thread_pool_->submit([this, i, &old_file, &new_file, start, block_size]() {
+        futures.push_back(thread_pool_->submit([this, i, &old_file, &new_file, new_index, start, block_size]() {
             const byte* new_data = new_file.data() + start;
             size_t new_block_size = static_cast<size_t>(block_size);
             
             const byte* old_data = old_file.data();
             size_t old_size = static_cast<size_t>(old_file.size());
+            auto anchors = anchors_in_range(anchors_, start, start + block_size);
             
-            // 使用全局索引
-            return block_processor_->process_block(
-                i, old_data, old_size, new_data, new_block_size, 
-                global_matcher_.get()
-            );
+            BlockResult result;
+            if (suffix_matcher_) {
+                result = block_processor_->process_block(
+                    i, old_data, old_size, new_data, new_block_size,
+                    *suffix_matcher_, anchors
+                );
+            } else {
+                // 使用全局索引
+                result = block_processor_->process_block(
+                    i, old_data, old_size, new_data, new_block_size, 
+                    global_matcher_.get(), anchors
+                );
+            }
+            
+            // 本块的新文件索引条目 (分段与块对齐)
+            if (new_index) {
+                new_index->collect(i);
+            }
+            return result;
         }));
     }
     
@@ -183,53 +306,50 @@ bool DiffEngine::write_patch_file(
     const MMapFile& new_file,
     const std::vector<BlockResult>& blocks,
     const std::array<uint8_t, 32>& old_hash,
-    const std::array<uint8_t, 32>& new_hash
+    const std::array<uint8_t, 32>& new_hash,
+    std::string& error
 ) {
-    // 使用 ofstream 直接写文件
-    std::ofstream file(path, std::ios::binary);
+    // 块数据的位置事先可以算出，文件头、块索引与各块一次提交，按偏移并发写入
+    auto file = AsyncFile::open(path, AsyncFile::Mode::Write, options_.io, error);
     if (!file) {
         return false;
     }
     
-    // 1. 写入 Header
+    // 1. Header
     PatchHeader header;
     header.init(options_.block_size, old_file.size(), new_file.size());
     std::memcpy(header.old_sha256, old_hash.data(), 32);
     std::memcpy(header.new_sha256, new_hash.data(), 32);
     header.num_blocks = static_cast<uint32_t>(blocks.size());
     
-    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // 2. 块索引与每块的 original_size / compressed_size
+    std::vector<uint64_t> block_offsets(blocks.size());
+    std::vector<uint32_t> block_sizes(blocks.size() * 2);
+    uint64_t offset = sizeof(header) + blocks.size() * sizeof(uint64_t);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        block_offsets[i] = offset;
+        block_sizes[2 * i] = blocks[i].original_size;
+        block_sizes[2 * i + 1] = static_cast<uint32_t>(blocks[i].data.size());
+        offset += 2 * sizeof(uint32_t) + blocks[i].data.size();
+    }
     
-    // 2. 先写入块索引占位符
-    uint64_t index_pos = static_cast<uint64_t>(file.tellp());
-    std::vector<uint64_t> block_offsets(blocks.size(), 0);
-    file.write(reinterpret_cast<const char*>(block_offsets.data()), 
-               blocks.size() * sizeof(uint64_t));
+    bool ok = file->submit_write(&header, sizeof(header), 0) &&
+              file->submit_write(block_offsets.data(), block_offsets.size() * sizeof(uint64_t), sizeof(header));
     
-    // 3. 写入块数据
-    for (size_t i = 0; i < blocks.size(); ++i) {
-        block_offsets[i] = static_cast<uint64_t>(file.tellp());
-        
-        // 写入 original_size
-        uint32_t orig_size = blocks[i].original_size;
-        file.write(reinterpret_cast<const char*>(&orig_size), sizeof(orig_size));
-        
-        // 写入 compressed_size
-        uint32_t comp_size = static_cast<uint32_t>(blocks[i].data.size());
-        file.write(reinterpret_cast<const char*>(&comp_size), sizeof(comp_size));
-        
-        // 写入压缩数据
-        if (comp_size > 0) {
-            file.write(reinterpret_cast<const char*>(blocks[i].data.data()), comp_size);
+    // 3. 块数据 (缓冲区在 wait_all 返回前保持有效)
+    for (size_t i = 0; ok && i < blocks.size(); ++i) {
+        ok = file->submit_write(&block_sizes[2 * i], 2 * sizeof(uint32_t), block_offsets[i]);
+        if (ok && !blocks[i].data.empty()) {
+            ok = file->submit_write(blocks[i].data.data(), blocks[i].data.size(),
+                                    block_offsets[i] + 2 * sizeof(uint32_t));
         }
     }
     
-    // 4. 回填块索引
-    file.seekp(static_cast<std::streamoff>(index_pos));
-    file.write(reinterpret_cast<const char*>(block_offsets.data()), 
-               blocks.size() * sizeof(uint64_t));
-    
-    return file.good();
+    if (!file->wait_all() || !ok) {
+        error = file->error();
+        return false;
+    }
+    return true;
 }
 
 } // namespace bindiff
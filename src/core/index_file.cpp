@@ -0,0 +1,228 @@
+#include "core/index_file.hpp"
+#include "io/mmap_file.hpp"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace bindiff {
+
+namespace {
+
+#if defined(BINDIFF_USE_RABIN_KARP) && BINDIFF_USE_RABIN_KARP
+constexpr uint16_t INDEX_HASH_KIND = 1;
+#else
+constexpr uint16_t INDEX_HASH_KIND = 0;
+#endif
+
+constexpr uint64_t SECTION_ALIGN = 64;
+
+inline uint64_t align_up(uint64_t value) {
+    return (value + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1);
+}
+
+// 各数组在文件中的起始位置
+struct IndexLayout {
+    uint64_t bucket_starts;
+    uint64_t offsets_lo;
+    uint64_t tags;
+    uint64_t offsets_hi;
+    uint64_t total;
+};
+
+IndexLayout compute_layout(uint64_t num_buckets, uint64_t num_entries, bool wide_offsets) {
+    IndexLayout layout;
+    layout.bucket_starts = align_up(IndexFileHeader::SIZE);
+    layout.offsets_lo = align_up(layout.bucket_starts + (num_buckets + 1) * sizeof(uint32_t));
+    layout.tags = align_up(layout.offsets_lo + num_entries * sizeof(uint32_t));
+    layout.offsets_hi = align_up(layout.tags + num_entries);
+    layout.total = wide_offsets ? layout.offsets_hi + num_entries : layout.tags + num_entries;
+    return layout;
+}
+
+// 文件修改时间 (纳秒)，取不到时返回 0
+int64_t file_mtime(const std::string& path) {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::string describe_sampling(size_t step, size_t winnow) {
+    return winnow > 0 ? "winnowing 窗口 " + std::to_string(winnow) : "采样步长 " + std::to_string(step);
+}
+
+bool write_section(std::ofstream& file, const void* data, uint64_t size, uint64_t position) {
+    static const char zeros[SECTION_ALIGN] = {};
+    uint64_t current = static_cast<uint64_t>(file.tellp());
+    if (position > current) {
+        file.write(zeros, static_cast<std::streamsize>(position - current));
+    }
+    if (size > 0) {
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+    return file.good();
+}
+
+} // namespace
+
+bool save_index_file(
+    const std::string& path,
+    const BlockMatcher& matcher,
+    const std::string& old_path, uint64_t old_size,
+    const std::array<uint8_t, 32>* old_sha256,
+    std::string& error
+) {
+    if (!matcher.has_index()) {
+        error = "索引未构建";
+        return false;
+    }
+    const IndexArrays& arrays = matcher.index_arrays();
+    bool wide_offsets = arrays.offsets_hi != nullptr;
+
+    IndexFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, IndexFileHeader::MAGIC, 4);
+    header.version = IndexFileHeader::VERSION;
+    header.hash_kind = INDEX_HASH_KIND;
+    header.old_size = old_size;
+    header.old_mtime = file_mtime(old_path);
+    if (old_sha256) {
+        std::memcpy(header.old_sha256, old_sha256->data(), 32);
+    }
+    header.min_match = static_cast<uint32_t>(matcher.min_match());
+    header.step = static_cast<uint32_t>(matcher.index_step());
+    header.winnow = static_cast<uint32_t>(matcher.index_winnow());
+    header.flags = (wide_offsets ? IndexFileHeader::FLAG_WIDE_OFFSETS : 0)
+                 | (old_sha256 ? IndexFileHeader::FLAG_HAS_SHA256 : 0);
+    header.num_buckets = arrays.num_buckets;
+    header.num_entries = arrays.num_entries;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        error = "无法创建索引文件: " + path;
+        return false;
+    }
+
+    IndexLayout layout = compute_layout(arrays.num_buckets, arrays.num_entries, wide_offsets);
+    bool ok = write_section(file, &header, sizeof(header), 0)
+           && write_section(file, arrays.bucket_starts, (arrays.num_buckets + 1) * sizeof(uint32_t),
+                            layout.bucket_starts)
+           && write_section(file, arrays.offsets_lo, arrays.num_entries * sizeof(uint32_t), layout.offsets_lo)
+           && write_section(file, arrays.tags, arrays.num_entries, layout.tags)
+           && (!wide_offsets || write_section(file, arrays.offsets_hi, arrays.num_entries, layout.offsets_hi));
+    if (!ok) {
+        error = "写入索引文件失败: " + path;
+        return false;
+    }
+    return true;
+}
+
+bool load_index_file(
+    const std::string& path,
+    BlockMatcher& matcher,
+    const std::string& old_path, uint64_t old_size,
+    const std::array<uint8_t, 32>* old_sha256,
+    std::string& error
+) {
+    auto mapping = std::make_unique<MMapFile>();
+    if (!mapping->open(path)) {
+        error = "无法打开索引文件: " + mapping->error();
+        return false;
+    }
+    uint64_t file_size = mapping->size();
+    if (file_size < IndexFileHeader::SIZE) {
+        error = "索引文件过小";
+        return false;
+    }
+
+    IndexFileHeader header;
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    if (std::memcmp(header.magic, IndexFileHeader::MAGIC, 4) != 0) {
+        error = "不是索引文件";
+        return false;
+    }
+    if (header.version != IndexFileHeader::VERSION) {
+        error = "不支持的索引文件版本: " + std::to_string(header.version);
+        return false;
+    }
+    if (header.hash_kind != INDEX_HASH_KIND) {
+        error = "索引文件使用了不同的哈希算法";
+        return false;
+    }
+    if (header.min_match != matcher.min_match()) {
+        error = "索引的最短匹配长度 (" + std::to_string(header.min_match) + ") 与当前设置 ("
+              + std::to_string(matcher.min_match()) + ") 不同";
+        return false;
+    }
+
+    // 采样方式由参数与文件大小决定，须与调用方现场建索引时相同
+    size_t step = 0, winnow = 0;
+    matcher.plan_sampling(old_size, step, winnow);
+    if (header.step != step || header.winnow != winnow) {
+        error = "索引的采样方式 (" + describe_sampling(header.step, header.winnow) + ") 与当前设置 ("
+              + describe_sampling(step, winnow) + ") 不同，须用相同的 --level / --winnow 构建索引";
+        return false;
+    }
+
+    // 与旧文件对应: 大小，以及 SHA256 (调用方已计算且索引有记录时) 或修改时间
+    if (header.old_size != old_size) {
+        error = "索引文件与原文件大小不符";
+        return false;
+    }
+    if (old_sha256 && (header.flags & IndexFileHeader::FLAG_HAS_SHA256)) {
+        if (std::memcmp(header.old_sha256, old_sha256->data(), 32) != 0) {
+            error = "索引文件与原文件 SHA256 不符";
+            return false;
+        }
+    } else if (header.old_mtime == 0 || header.old_mtime != file_mtime(old_path)) {
+        error = "索引文件与原文件修改时间不符 (原文件可能已改动，请重新构建索引)";
+        return false;
+    }
+
+    // 结构检查: 先限制数量再计算布局，避免溢出
+    bool wide_offsets = (header.flags & IndexFileHeader::FLAG_WIDE_OFFSETS) != 0;
+    bool sizes_ok = header.num_buckets > 0
+                 && (header.num_buckets & (header.num_buckets - 1)) == 0
+                 && header.num_buckets <= file_size
+                 && header.num_entries <= file_size
+                 && header.num_entries <= UINT32_MAX
+                 && header.step > 0
+                 && header.winnow <= BlockMatcher::MAX_WINNOW_WINDOW;
+    IndexLayout layout{};
+    if (sizes_ok) {
+        layout = compute_layout(header.num_buckets, header.num_entries, wide_offsets);
+        sizes_ok = layout.total <= file_size;
+    }
+    if (!sizes_ok) {
+        error = "索引文件已损坏 (结构不一致)";
+        return false;
+    }
+
+    const byte* base = mapping->data();
+    IndexArrays arrays;
+    arrays.bucket_starts = reinterpret_cast<const uint32_t*>(base + layout.bucket_starts);
+    arrays.offsets_lo = reinterpret_cast<const uint32_t*>(base + layout.offsets_lo);
+    arrays.tags = base + layout.tags;
+    arrays.offsets_hi = wide_offsets ? base + layout.offsets_hi : nullptr;
+    arrays.num_buckets = header.num_buckets;
+    arrays.num_entries = header.num_entries;
+
+    // 桶起始位置必须单调且不越界，查询时才不会读出数组之外
+    bool buckets_ok = arrays.bucket_starts[0] == 0 &&
+                      arrays.bucket_starts[arrays.num_buckets] == arrays.num_entries;
+    for (size_t b = 0; buckets_ok && b < arrays.num_buckets; ++b) {
+        buckets_ok = arrays.bucket_starts[b] <= arrays.bucket_starts[b + 1];
+    }
+    if (!buckets_ok) {
+        error = "索引文件已损坏 (桶表不一致)";
+        return false;
+    }
+
+    matcher.adopt_index(arrays, header.step, header.winnow, std::move(mapping));
+    return true;
+}
+
+} // namespace bindiff
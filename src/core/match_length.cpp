@@ -0,0 +1,283 @@
+#include "core/match_length.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BINDIFF_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define BINDIFF_X86 0
+#endif
+
+// GCC/Clang 需要为单个函数启用指令集，MSVC 可直接使用内建函数
+#if BINDIFF_X86 && (defined(__GNUC__) || defined(__clang__))
+#define BINDIFF_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BINDIFF_TARGET(isa)
+#endif
+
+namespace bindiff {
+
+namespace {
+
+inline unsigned count_trailing_zeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<unsigned>(index);
+#else
+    unsigned n = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+inline unsigned count_leading_zeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_clzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63u - static_cast<unsigned>(index);
+#else
+    unsigned n = 0;
+    while ((x & (uint64_t(1) << 63)) == 0) {
+        x <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// 尾部不足一个向量宽度时逐 8 字节、逐字节比较
+inline size_t match_tail(const byte* a, const byte* b, size_t len, size_t max_len) {
+    while (len + 8 <= max_len) {
+        uint64_t va, vb;
+        std::memcpy(&va, a + len, 8);
+        std::memcpy(&vb, b + len, 8);
+        uint64_t diff = va ^ vb;
+        if (diff != 0) {
+            // 小端序: 最低的非零字节即第一个不同的字节
+            return len + count_trailing_zeros(diff) / 8;
+        }
+        len += 8;
+    }
+    while (len < max_len && a[len] == b[len]) {
+        ++len;
+    }
+    return len;
+}
+
+size_t match_length_scalar(const byte* a, const byte* b, size_t max_len) {
+    return match_tail(a, b, 0, max_len);
+}
+
+#if BINDIFF_X86
+
+BINDIFF_TARGET("sse2")
+size_t match_length_sse2(const byte* a, const byte* b, size_t max_len) {
+    size_t len = 0;
+    while (len + 16 <= max_len) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + len));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + len));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+        if (mask != 0xFFFF) {
+            return len + count_trailing_zeros(~mask & 0xFFFF);
+        }
+        len += 16;
+    }
+    return match_tail(a, b, len, max_len);
+}
+
+BINDIFF_TARGET("avx2")
+size_t match_length_avx2(const byte* a, const byte* b, size_t max_len) {
+    size_t len = 0;
+    
+    // 长匹配时每次比较 64 字节，减少分支
+    while (len + 64 <= max_len) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + len));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + len));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + len + 32));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + len + 32));
+        uint32_t m0 = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a0, b0)));
+        uint32_t m1 = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a1, b1)));
+        uint64_t mask = (static_cast<uint64_t>(m1) << 32) | m0;
+        if (mask != ~uint64_t(0)) {
+            return len + count_trailing_zeros(~mask);
+        }
+        len += 64;
+    }
+    while (len + 32 <= max_len) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + len));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + len));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        if (mask != 0xFFFFFFFFu) {
+            return len + count_trailing_zeros(~mask);
+        }
+        len += 32;
+    }
+    return match_tail(a, b, len, max_len);
+}
+
+BINDIFF_TARGET("avx512f,avx512bw")
+size_t match_length_avx512(const byte* a, const byte* b, size_t max_len) {
+    size_t len = 0;
+    while (len + 64 <= max_len) {
+        __m512i va = _mm512_loadu_si512(reinterpret_cast<const void*>(a + len));
+        __m512i vb = _mm512_loadu_si512(reinterpret_cast<const void*>(b + len));
+        uint64_t diff = _mm512_cmpneq_epi8_mask(va, vb);
+        if (diff != 0) {
+            return len + count_trailing_zeros(diff);
+        }
+        len += 64;
+    }
+    
+    // 尾部用掩码加载，避免越界读取
+    if (len < max_len) {
+        __mmask64 valid = (uint64_t(1) << (max_len - len)) - 1;
+        __m512i va = _mm512_maskz_loadu_epi8(valid, a + len);
+        __m512i vb = _mm512_maskz_loadu_epi8(valid, b + len);
+        uint64_t diff = _mm512_mask_cmpneq_epi8_mask(valid, va, vb);
+        return diff != 0 ? len + count_trailing_zeros(diff) : max_len;
+    }
+    return len;
+}
+
+// ============== CPU 特性检测 ==============
+
+struct CpuFeatures {
+    bool sse2 = false;
+    bool avx2 = false;
+    bool avx512bw = false;
+};
+
+CpuFeatures detect_cpu_features() {
+    CpuFeatures f;
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    f.sse2 = __builtin_cpu_supports("sse2");
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.avx512bw = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    
+    __cpuid(info, 1);
+    f.sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    
+    // 操作系统需保存 YMM / ZMM 状态
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool os_avx = (xcr0 & 0x6) == 0x6;
+    bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+    
+    if (max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        f.avx2 = os_avx && (info[1] & (1 << 5)) != 0;
+        f.avx512bw = os_avx512 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+    }
+#endif
+    return f;
+}
+
+const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+#endif  // BINDIFF_X86
+
+MatchKernel select_kernel() {
+    if (match_kernel_supported(MatchKernel::AVX512)) return MatchKernel::AVX512;
+    if (match_kernel_supported(MatchKernel::AVX2)) return MatchKernel::AVX2;
+    if (match_kernel_supported(MatchKernel::SSE2)) return MatchKernel::SSE2;
+    return MatchKernel::Scalar;
+}
+
+} // namespace
+
+size_t match_length(const byte* a, const byte* b, size_t max_len) {
+    // 首次调用时选定 (不依赖各翻译单元静态初始化的先后，其他静态对象的构造中也可调用)，之后只有一次间接跳转
+    static const MatchLengthFn kernel = match_kernel(active_match_kernel());
+    return kernel(a, b, max_len);
+}
+
+size_t match_length_backward(const byte* a_end, const byte* b_end, size_t max_len) {
+    size_t len = 0;
+    while (len + 8 <= max_len) {
+        uint64_t va, vb;
+        std::memcpy(&va, a_end - len - 8, 8);
+        std::memcpy(&vb, b_end - len - 8, 8);
+        uint64_t diff = va ^ vb;
+        if (diff != 0) {
+            // 小端序: 最高的非零字节即从后往前第一个不同的字节
+            return len + count_leading_zeros(diff) / 8;
+        }
+        len += 8;
+    }
+    while (len < max_len && *(a_end - len - 1) == *(b_end - len - 1)) {
+        ++len;
+    }
+    return len;
+}
+
+bool match_kernel_supported(MatchKernel kernel) {
+    switch (kernel) {
+        case MatchKernel::Scalar:
+            return true;
+#if BINDIFF_X86
+        case MatchKernel::SSE2:
+            return cpu_features().sse2;
+        case MatchKernel::AVX2:
+            return cpu_features().avx2;
+        case MatchKernel::AVX512:
+            return cpu_features().avx512bw;
+#endif
+        default:
+            return false;
+    }
+}
+
+MatchLengthFn match_kernel(MatchKernel kernel) {
+    if (!match_kernel_supported(kernel)) {
+        return nullptr;
+    }
+    switch (kernel) {
+#if BINDIFF_X86
+        case MatchKernel::SSE2:
+            return match_length_sse2;
+        case MatchKernel::AVX2:
+            return match_length_avx2;
+        case MatchKernel::AVX512:
+            return match_length_avx512;
+#endif
+        case MatchKernel::Scalar:
+        default:
+            return match_length_scalar;
+    }
+}
+
+MatchKernel active_match_kernel() {
+    static const MatchKernel kernel = select_kernel();
+    return kernel;
+}
+
+const char* match_kernel_name(MatchKernel kernel) {
+    switch (kernel) {
+        case MatchKernel::SSE2:   return "SSE2";
+        case MatchKernel::AVX2:   return "AVX2";
+        case MatchKernel::AVX512: return "AVX-512";
+        case MatchKernel::Scalar:
+        default:                  return "Scalar";
+    }
+}
+
+} // namespace bindiff
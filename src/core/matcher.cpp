@@ -1,11 +1,11 @@
 #include "core/matcher.hpp"
+#include "core/match_length.hpp"
+#include "io/mmap_file.hpp"
 #include <algorithm>
 #include <cstring>
+#include <numeric>
 #include <thread>
-
-#ifdef __SSE2__
-#include <emmintrin.h>
-#endif
+#include <unordered_map>
 
 namespace bindiff {
 
@@ -99,11 +99,309 @@ uint64_t RollingHash::add_mod(uint64_t a, uint64_t b) {
 
 // ============== BlockMatcher 实现 ==============
 
+namespace {
+
+// 将 [0, count) 均分给 num_threads 个线程执行 fn(begin, end)
+template<typename Fn>
+void parallel_for(size_t count, int num_threads, Fn&& fn) {
+    if (num_threads <= 1 || count < static_cast<size_t>(num_threads)) {
+        fn(size_t(0), count);
+        return;
+    }
+    
+    size_t per_thread = (count + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        size_t begin = std::min(count, t * per_thread);
+        size_t end = std::min(count, begin + per_thread);
+        threads.emplace_back([&fn, begin, end]() { fn(begin, end); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// winnowing: 每 w 个连续窗口哈希中取最小者 (相同时取最右)
+// 处理第 [begin, end) 个窗口 (第 i 个窗口由起点 [i, i + span) 的窗口哈希组成)，
+// 按升序对每个选中的起点调用 emit(起点, 窗口哈希)
+// 连续重复的内容 (如填充字节) 哈希相同，其中相距不足 w 的选中位置只保留一个
+template<typename Emit>
+void winnow_range(const byte* data, size_t chunk_size, size_t w, size_t span, size_t begin, size_t end,
+                  Emit&& emit) {
+    // 分批处理窗口: 哈希按 span 分段，段内前缀最小与后缀最小组合出每个窗口的最小值
+    // (van Herk / Gil-Werman)，比单调队列少了难以预测的分支
+    constexpr size_t BATCH = 16384;
+    std::vector<uint64_t> hashes(BATCH + span);
+    std::vector<uint32_t> prefix_pos(BATCH + span);
+    std::vector<uint64_t> prefix_hash(BATCH + span);
+    std::vector<uint32_t> suffix_pos(BATCH + span);
+    std::vector<uint64_t> suffix_hash(BATCH + span);
+    
+    std::vector<uint64_t> batch_pos(BATCH);
+    std::vector<uint64_t> batch_hash(BATCH);
+    
+    IndexHash hasher(chunk_size);
+    bool has_last = false;
+    uint64_t last_pos = 0;
+    uint64_t last_hash = 0;
+    
+    for (size_t base = begin; base < end; base += BATCH) {
+        size_t count = std::min(BATCH, end - base);     // 本批窗口数
+        size_t n = count + span - 1;                    // 本批需要的哈希数
+        for (size_t j = 0; j < n; ++j) {
+            if (j == 0) {
+                hasher.init(data + base, chunk_size);
+            } else {
+                hasher.roll(data[base + j - 1], data[base + j + chunk_size - 1]);
+            }
+            hashes[j] = hasher.hash();
+        }
+        
+        // 段内前缀最小 (相同时取右侧) 与后缀最小 (相同时保留右侧)
+        // 当前最小值保存在寄存器中，避免每步重新读取 hashes[best] 形成的依赖链
+        for (size_t seg = 0; seg < n; seg += span) {
+            size_t seg_end = std::min(seg + span, n);
+            uint64_t best_hash = UINT64_MAX;
+            uint32_t best = static_cast<uint32_t>(seg);
+            for (size_t j = seg; j < seg_end; ++j) {
+                bool take = hashes[j] <= best_hash;
+                best_hash = take ? hashes[j] : best_hash;
+                best = take ? static_cast<uint32_t>(j) : best;
+                prefix_pos[j] = best;
+                prefix_hash[j] = best_hash;
+            }
+            best_hash = UINT64_MAX;
+            best = static_cast<uint32_t>(seg_end - 1);
+            for (size_t j = seg_end; j-- > seg;) {
+                bool take = hashes[j] < best_hash;
+                best_hash = take ? hashes[j] : best_hash;
+                best = take ? static_cast<uint32_t>(j) : best;
+                suffix_pos[j] = best;
+                suffix_hash[j] = best_hash;
+            }
+        }
+        
+        // 相邻窗口常选中同一位置，无分支地只保留变化处
+        size_t selected = 0;
+        uint64_t prev = UINT64_MAX;
+        for (size_t i = 0; i < count; ++i) {
+            // 窗口 [i, i + span) 由 i 所在段的后缀与下一段的前缀组成 (i 为段首时只有前缀)
+            size_t r = i + span - 1;
+            bool take_right = prefix_hash[r] <= suffix_hash[i];
+            uint64_t pos = base + (take_right ? prefix_pos[r] : suffix_pos[i]);
+            batch_pos[selected] = pos;
+            batch_hash[selected] = take_right ? prefix_hash[r] : suffix_hash[i];
+            selected += pos != prev;
+            prev = pos;
+        }
+        
+        // 重复内容的去重 (随机内容上几乎不触发，分支可预测)
+        for (size_t k = 0; k < selected; ++k) {
+            if (has_last && batch_hash[k] == last_hash && batch_pos[k] - last_pos < w) {
+                continue;
+            }
+            emit(batch_pos[k], batch_hash[k]);
+            last_pos = batch_pos[k];
+            last_hash = batch_hash[k];
+            has_last = true;
+        }
+    }
+}
+
+// ============== 重复区段 ==============
+
+// 周期不超过 MAX_RUN_PERIOD 的重复区段 (填充字节、重复的短模式)
+// 区段内的窗口内容只有 period 种，全部进入索引只会让同一个桶塞满无用的候选
+struct Run {
+    uint64_t offset;
+    uint64_t length;
+    uint32_t period;
+    
+    uint64_t end() const { return offset + length; }
+};
+
+constexpr size_t MAX_RUN_PERIOD = 16;
+constexpr size_t RUN_PROBE = 64;         // 每隔 RUN_PROBE 字节检查一次是否处于重复区段
+constexpr size_t MIN_RUN_LENGTH = 256;
+
+// build_index_parallel 每段的大小上限 (段内偏移以 32 位保存)
+constexpr size_t MAX_SEGMENT_SIZE = size_t(1) << 30;
+
+inline uint64_t load64(const byte* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+// 找出长度 >= MIN_RUN_LENGTH 的重复区段 (按偏移升序、互不重叠)
+// 每个检查点取最小周期，命中后向两侧扩展到区段边界
+std::vector<Run> find_runs(const byte* data, size_t size, int num_threads) {
+    if (size < RUN_PROBE + MAX_RUN_PERIOD) {
+        return {};
+    }
+    size_t probes = (size - RUN_PROBE - MAX_RUN_PERIOD) / RUN_PROBE + 1;
+    
+    std::vector<std::vector<Run>> parts(std::max(num_threads, 1));
+    size_t per_thread = (probes + parts.size() - 1) / parts.size();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < parts.size(); ++t) {
+        size_t begin = std::min(probes, t * per_thread);
+        size_t end = std::min(probes, begin + per_thread);
+        threads.emplace_back([&, t, begin, end]() {
+            size_t covered = 0;
+            for (size_t k = begin; k < end; ++k) {
+                size_t i = k * RUN_PROBE;
+                if (i < covered) {
+                    continue;
+                }
+                // 随机内容上前 8 字节几乎总是不同，每个周期只需一次比较
+                uint64_t head = load64(data + i);
+                size_t period = 0;
+                for (size_t p = 1; p <= MAX_RUN_PERIOD; ++p) {
+                    if (load64(data + i + p) == head && std::memcmp(data + i, data + i + p, RUN_PROBE) == 0) {
+                        period = p;
+                        break;
+                    }
+                }
+                if (period == 0) {
+                    continue;
+                }
+                
+                size_t start = i - match_length_backward(data + i, data + i + period, i);
+                size_t run_end = i + period + match_length(data + i, data + i + period, size - i - period);
+                covered = run_end;
+                if (run_end - start >= MIN_RUN_LENGTH) {
+                    parts[t].push_back({start, run_end - start, static_cast<uint32_t>(period)});
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    // 跨越切片的区段会被相邻切片各找到一次
+    std::vector<Run> runs;
+    for (const auto& part : parts) {
+        for (const auto& run : part) {
+            if (runs.empty() || run.offset >= runs.back().end()) {
+                runs.push_back(run);
+            }
+        }
+    }
+    return runs;
+}
+
+// 每种重复模式只保留最长的区段，返回其前 period 个窗口的起点 (覆盖所有相位)
+// 查询窗口落在任何同模式的重复区段中时，都能通过这几个条目之一找到最长的那个
+std::vector<uint64_t> run_representatives(const std::vector<Run>& runs, const byte* data, size_t chunk_size) {
+    std::unordered_map<std::string, size_t> longest;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const Run& run = runs[r];
+        if (run.length < chunk_size + run.period - 1) {
+            continue;
+        }
+        // 模式取字典序最小的旋转，使不同相位开始的同模式区段对应同一个键
+        const byte* base = data + run.offset;
+        size_t best = 0;
+        for (size_t k = 1; k < run.period; ++k) {
+            if (std::memcmp(base + k, base + best, run.period) < 0) {
+                best = k;
+            }
+        }
+        std::string key(reinterpret_cast<const char*>(base + best), run.period);
+        auto it = longest.emplace(key, r).first;
+        if (runs[it->second].length < run.length) {
+            it->second = r;
+        }
+    }
+    
+    std::vector<uint64_t> offsets;
+    for (const auto& item : longest) {
+        const Run& run = runs[item.second];
+        for (size_t k = 0; k < run.period; ++k) {
+            offsets.push_back(run.offset + k);
+        }
+    }
+    std::sort(offsets.begin(), offsets.end());
+    return offsets;
+}
+
+} // namespace
+
 BlockMatcher::BlockMatcher(size_t min_match)
     : min_match_(min_match)
-    , hasher_(min_match)
 {
-    hash_table_.resize(HASH_BUCKETS);
+    params_.min_match = min_match;
+}
+
+BlockMatcher::BlockMatcher(const MatcherParams& params)
+    : min_match_(params.min_match)
+    , params_(params)
+{
+}
+
+BlockMatcher::~BlockMatcher() = default;
+
+void BlockMatcher::adopt_index(const IndexArrays& arrays, size_t step, size_t winnow,
+                               std::unique_ptr<MMapFile> mapping) {
+    std::vector<uint32_t>().swap(bucket_starts_);
+    std::vector<uint32_t>().swap(offsets_lo_);
+    std::vector<uint8_t>().swap(offsets_hi_);
+    std::vector<uint8_t>().swap(tags_);
+    
+    index_ = arrays;
+    bucket_mask_ = arrays.num_buckets - 1;
+    step_ = step;
+    winnow_ = winnow;
+    mapping_ = std::move(mapping);
+}
+
+size_t BlockMatcher::index_memory() const {
+    return bucket_starts_.capacity() * sizeof(uint32_t)
+         + offsets_lo_.capacity() * sizeof(uint32_t)
+         + offsets_hi_.capacity() * sizeof(uint8_t)
+         + tags_.capacity() * sizeof(uint8_t);
+}
+
+void BlockMatcher::plan_sampling(size_t size, size_t& step, size_t& winnow) const {
+    step = 1;
+    winnow = 0;
+    if (size < min_match_) {
+        return;
+    }
+    winnow = winnow_window(size, min_match_);
+    step = winnow > 0 ? 1 : sampling_step(size, min_match_);
+}
+
+size_t BlockMatcher::sampling_step(size_t size, size_t chunk_size) const {
+    // 每隔一定步长采样，而不是每个位置都建索引
+    size_t step = 1;
+    if (size > 100 * 1024 * 1024) {  // > 100MB
+        step = params_.sample_step_large;
+    }
+    if (size > 1024 * 1024 * 1024) {  // > 1GB
+        step = params_.sample_step_huge;
+    }
+    
+    // 条目数超出上限时继续增大步长，而不是丢弃文件后部的偏移
+    size_t positions = size - chunk_size + 1;
+    size_t max_entries = params_.max_index_entries;
+    step = std::max(step, (positions + max_entries - 1) / max_entries);
+    return std::max<size_t>(step, 1);
+}
+
+size_t BlockMatcher::winnow_window(size_t size, size_t chunk_size) const {
+    if (params_.winnow_guarantee == 0) {
+        return 0;
+    }
+    size_t w = params_.winnow_guarantee > chunk_size ? params_.winnow_guarantee - chunk_size + 1 : 1;
+    
+    // 随机内容上 winnowing 的选中密度约为 2 / (w + 1)
+    size_t positions = size - chunk_size + 1;
+    size_t max_entries = params_.max_index_entries;
+    w = std::max(w, (2 * positions + max_entries - 1) / max_entries);
+    return w <= MAX_WINNOW_WINDOW ? w : 0;
 }
 
 Match BlockMatcher::find_longest_match(
@@ -112,117 +410,126 @@ Match BlockMatcher::find_longest_match(
     const byte* new_data, 
     size_t new_size,
     size_t new_offset
-) {
-    Match match;
-    
+) const {
     if (new_offset + min_match_ > new_size) {
-        return match;
+        return Match{};
     }
     
     // 如果有索引，使用哈希表快速查找
-    if (!hash_table_[0].empty()) {
-        hasher_.init(new_data + new_offset, min_match_);
-        uint64_t target_hash = hasher_.hash();
-        size_t bucket = hash_to_bucket(target_hash);
-        
-        // 优化：优先检查靠近 new_offset 的位置
-        // 并在找到足够长的匹配后提前退出
-        for (size_t old_pos : hash_table_[bucket]) {
-            // 快速检查前几个字节是否匹配
-            if (old_data[old_pos] != new_data[new_offset] ||
-                old_data[old_pos + 1] != new_data[new_offset + 1]) {
-                continue;
-            }
-            
-            // SIMD 优化：批量比较字节
-            size_t len = 0;
-            const size_t simd_width = 16;
-            
-            // 先用 SIMD 比较前 16 字节
-            #ifdef __SSE2__
-            if (new_size - new_offset >= simd_width && old_size - old_pos >= simd_width) {
-                __m128i v_old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(old_data + old_pos));
-                __m128i v_new = _mm_loadu_si128(reinterpret_cast<const __m128i*>(new_data + new_offset));
-                __m128i v_cmp = _mm_cmpeq_epi8(v_old, v_new);
-                int mask = _mm_movemask_epi8(v_cmp);
-                
-                if (mask != 0xFFFF) {
-                    // 前 16 字节有不匹配，跳过
-                    continue;
-                }
-                len = simd_width;
-            }
-            #endif
-            
-            // 继续逐字节比较剩余部分
-            while (len < old_size - old_pos && 
-                   len < new_size - new_offset &&
-                   old_data[old_pos + len] == new_data[new_offset + len]) {
-                ++len;
-            }
-            
-            if (len >= min_match_ && len > match.length) {
-                match.old_offset = old_pos;
-                match.length = len;
-                
-                // 优化：如果找到长匹配，提前退出
-                if (len >= 4096) {
-                    break;  // 4KB 以上匹配足够好
-                }
-            }
+    if (has_index()) {
+        IndexHash hasher(min_match_);
+        hasher.init(new_data + new_offset, min_match_);
+        return probe_index(hasher.hash(), old_data, old_size, new_data, new_size, new_offset);
+    }
+    
+    return scan_without_index(old_data, old_size, new_data, new_size, new_offset);
+}
+
+Match BlockMatcher::probe_index(
+    uint64_t window_hash,
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    size_t new_offset
+) const {
+    Match match;
+    size_t bucket = hash_to_bucket(window_hash);
+    uint8_t tag = hash_to_tag(window_hash);
+    
+    // 桶内候选在内存中连续，按旧文件偏移升序排列 (重复区段的代表条目排在最后)
+    // 在找到足够长的匹配后提前退出
+    size_t begin = index_.bucket_starts[bucket];
+    size_t end = std::min(static_cast<size_t>(index_.bucket_starts[bucket + 1]), begin + params_.max_probes);
+    for (size_t e = begin; e < end; ++e) {
+        if (index_.tags[e] != tag) {
+            continue;
         }
-    } else {
-        // 无索引，使用快速滑动窗口搜索
-        // 动态调整搜索范围：对于大文件，搜索前 10MB 或 10% 的数据
-        size_t max_search = std::min(
-            old_size, 
-            std::max(
-                static_cast<size_t>(1000000),  // 至少 1MB
-                std::min(
-                    old_size / 10,              // 最多搜索 10% 的数据
-                    static_cast<size_t>(10000000)  // 但不超过 10MB
-                )
-            )
-        );
         
-        size_t best_offset = 0;
-        size_t best_length = 0;
+        size_t old_pos = entry_offset(e);
+        if (old_pos + min_match_ > old_size) {
+            continue;
+        }
         
-        hasher_.init(new_data + new_offset, min_match_);
-        uint64_t target_hash = hasher_.hash();
+        // 快速检查前几个字节是否匹配
+        if (old_data[old_pos] != new_data[new_offset] ||
+            old_data[old_pos + 1] != new_data[new_offset + 1]) {
+            continue;
+        }
         
-        RollingHash old_hasher(min_match_);
+        // 向量化比较，内核在运行时按 CPU 选择
+        size_t len = match_length(old_data + old_pos, new_data + new_offset,
+                                  std::min(old_size - old_pos, new_size - new_offset));
         
-        for (size_t i = 0; i <= old_size - min_match_ && i < max_search; ) {
-            if (i == 0) {
-                old_hasher.init(old_data, min_match_);
-            } else {
-                old_hasher.roll(old_data[i - 1], old_data[i + min_match_ - 1]);
+        if (len >= min_match_ && len > match.length) {
+            match.old_offset = old_pos;
+            match.length = len;
+            
+            // 优化：如果找到足够长的匹配，提前退出
+            if (len >= params_.good_match) {
+                break;
             }
+        }
+    }
+    
+    return match;
+}
+
+Match BlockMatcher::scan_without_index(
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    size_t new_offset
+) const {
+    Match match;
+    if (old_size < min_match_) {
+        return match;
+    }
+    
+    // 无索引，使用快速滑动窗口搜索
+    // 动态调整搜索范围：对于大文件，搜索前 10MB 或 10% 的数据
+    size_t max_search = std::min(
+        old_size, 
+        std::max(
+            static_cast<size_t>(1000000),  // 至少 1MB
+            std::min(
+                old_size / 10,              // 最多搜索 10% 的数据
+                static_cast<size_t>(10000000)  // 但不超过 10MB
+            )
+        )
+    );
+    
+    size_t best_offset = 0;
+    size_t best_length = 0;
+    
+    IndexHash hasher(min_match_);
+    hasher.init(new_data + new_offset, min_match_);
+    uint64_t target_hash = hasher.hash();
+    
+    IndexHash old_hasher(min_match_);
+    
+    for (size_t i = 0; i <= old_size - min_match_ && i < max_search; ) {
+        if (i == 0) {
+            old_hasher.init(old_data, min_match_);
+        } else {
+            old_hasher.roll(old_data[i - 1], old_data[i + min_match_ - 1]);
+        }
+        
+        if (old_hasher.hash() == target_hash) {
+            size_t len = match_length(old_data + i, new_data + new_offset,
+                                      std::min(old_size - i, new_size - new_offset));
             
-            if (old_hasher.hash() == target_hash) {
-                size_t len = 0;
-                while (len < old_size - i && 
-                       len < new_size - new_offset &&
-                       old_data[i + len] == new_data[new_offset + len]) {
-                    ++len;
-                }
+            if (len >= min_match_ && len > best_length) {
+                best_length = len;
+                best_offset = i;
                 
-                if (len >= min_match_ && len > best_length) {
-                    best_length = len;
-                    best_offset = i;
-                    
-                    if (best_length >= 1024) break;
-                }
+                if (best_length >= params_.scan_good_match) break;
             }
-            
-            ++i;
         }
         
-        if (best_length >= min_match_) {
-            match.old_offset = best_offset;
-            match.length = best_length;
-        }
+        ++i;
+    }
+    
+    if (best_length >= min_match_) {
+        match.old_offset = best_offset;
+        match.length = best_length;
     }
     
     return match;
@@ -238,15 +545,15 @@ std::vector<Match> BlockMatcher::find_all_matches(
     
     build_index(old_data, old_size, min_match_);
     
-    size_t pos = 0;
-    while (pos + min_match_ <= new_size) {
-        auto match = find_longest_match(old_data, old_size, new_data, new_size, pos);
+    MatchCursor cursor(*this, old_data, old_size, new_data, new_size);
+    while (cursor.has_window()) {
+        auto match = cursor.find();
         
         if (match.valid()) {
             matches.push_back(match);
-            pos += match.length;
+            cursor.seek(cursor.position() + match.length);
         } else {
-            ++pos;
+            cursor.advance();
         }
     }
     
@@ -254,119 +561,496 @@ std::vector<Match> BlockMatcher::find_all_matches(
 }
 
 void BlockMatcher::build_index(const byte* data, size_t size, size_t chunk_size) {
-    for (auto& bucket : hash_table_) {
-        bucket.clear();
+    build_index_parallel(data, size, chunk_size, 1);
+}
+
+void BlockMatcher::build_index_parallel(const byte* data, size_t size, size_t chunk_size, int num_threads,
+                                        const std::vector<ByteRange>& skip) {
+    // 确定线程数
+    if (num_threads <= 0) {
+        num_threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (num_threads <= 0) num_threads = 4;
     }
     
-    if (size < chunk_size) return;
+    // 每个线程收集连续的一段 (段内偏移以 32 位保存，超大文件再细分)
+    size_t per_thread = (size + num_threads - 1) / num_threads;
+    IndexBuilder builder(*this, data, size, chunk_size, std::min(per_thread, MAX_SEGMENT_SIZE), num_threads, skip);
+    parallel_for(builder.segments(), num_threads, [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; ++k) {
+            builder.collect(k);
+        }
+    });
+    builder.finish();
+}
+
+// ============== IndexBuilder 实现 ==============
+
+IndexBuilder::IndexBuilder(BlockMatcher& matcher, const byte* data, size_t size, size_t chunk_size,
+                           size_t segment_size, int num_threads, const std::vector<ByteRange>& skip)
+    : matcher_(matcher)
+    , data_(data)
+    , size_(size)
+    , chunk_size_(chunk_size)
+    , segment_size_(std::max<size_t>(segment_size, 1))
+    , num_threads_(num_threads)
+{
+    if (num_threads_ <= 0) {
+        num_threads_ = static_cast<int>(std::thread::hardware_concurrency());
+        if (num_threads_ <= 0) num_threads_ = 4;
+    }
     
-    RollingHash hasher(chunk_size);
-    hasher.init(data, chunk_size);
+    // 释放旧索引
+    std::vector<uint32_t>().swap(matcher_.bucket_starts_);
+    std::vector<uint32_t>().swap(matcher_.offsets_lo_);
+    std::vector<uint8_t>().swap(matcher_.offsets_hi_);
+    std::vector<uint8_t>().swap(matcher_.tags_);
+    matcher_.index_ = IndexArrays{};
+    matcher_.mapping_.reset();
+    matcher_.bucket_mask_ = 0;
+    matcher_.step_ = 1;
+    matcher_.winnow_ = 0;
     
-    uint64_t hash = hasher.hash();
-    size_t bucket = hash_to_bucket(hash);
-    hash_table_[bucket].push_back(0);
+    if (chunk_size_ == 0 || size_ < chunk_size_) return;
     
-    // 优化：每隔一定步长采样，而不是每个位置都建索引
-    // 对于大文件，减少索引大小，降低内存占用和冲突
-    size_t step = 1;
-    if (size > 100 * 1024 * 1024) {  // > 100MB
-        step = 4;  // 每 4 字节采样一次
+    // 确定采样方式: 固定步长时条目为 step 的倍数，winnowing 时为各窗口选中的位置
+    matcher_.winnow_ = matcher_.winnow_window(size_, chunk_size_);
+    matcher_.step_ = matcher_.winnow_ > 0 ? 1 : matcher_.sampling_step(size_, chunk_size_);
+    positions_ = size_ - chunk_size_ + 1;
+    num_segments_ = (size_ + segment_size_ - 1) / segment_size_;
+    segments_.resize(num_segments_);
+    
+    // 重复区段内的窗口不逐个建索引，每种模式只保留最长区段的 period 个条目
+    std::vector<Run> runs = find_runs(data_, size_, num_threads_);
+    
+    // 整理跳过区间 (排序并合并)
+    for (const auto& range : skip) {
+        if (range.length >= chunk_size_) ranges_.push_back(range);
     }
-    if (size > 1024 * 1024 * 1024) {  // > 1GB
-        step = 8;  // 每 8 字节采样一次
+    for (const auto& run : runs) {
+        if (run.length >= chunk_size_) ranges_.push_back({run.offset, run.length});
+    }
+    std::sort(ranges_.begin(), ranges_.end(), [](const ByteRange& a, const ByteRange& b) {
+        return a.offset < b.offset;
+    });
+    size_t merged = 0;
+    for (size_t r = 0; r < ranges_.size(); ++r) {
+        if (merged > 0 && ranges_[r].offset <= ranges_[merged - 1].end()) {
+            uint64_t end = std::max(ranges_[merged - 1].end(), ranges_[r].end());
+            ranges_[merged - 1].length = end - ranges_[merged - 1].offset;
+        } else {
+            ranges_[merged++] = ranges_[r];
+        }
     }
+    ranges_.resize(merged);
     
-    for (size_t i = 1; i + chunk_size <= size; i += step) {
-        // 滚动计算哈希（根据步长调整）
-        for (size_t j = 1; j <= step && i + chunk_size <= size; ++j, ++i) {
-            hasher.roll(data[i - 1], data[i + chunk_size - 1]);
+    // 代表条目位于区段之内，不做跳过检查，排在所有采样条目之后
+    IndexHash hasher(chunk_size_);
+    for (uint64_t offset : run_representatives(runs, data_, chunk_size_)) {
+        if (segments_.size() == num_segments_ || offset - segments_.back().base > UINT32_MAX) {
+            segments_.emplace_back();
+            segments_.back().base = offset;
         }
+        Segment& segment = segments_.back();
+        hasher.init(data_ + offset, chunk_size_);
+        segment.offsets.push_back(static_cast<uint32_t>(offset - segment.base));
+        segment.hashes.push_back(static_cast<uint32_t>(hasher.hash()) & HASH_BITS);
+        segment.tags.push_back(BlockMatcher::hash_to_tag(hasher.hash()));
+        ++segment.entries;
+    }
+}
+
+bool IndexBuilder::skipped(size_t& range, uint64_t offset) const {
+    // 窗口右端单调递增，结束于其之前的区间不可能再包含后续窗口
+    while (range < ranges_.size() && ranges_[range].end() < offset + chunk_size_) {
+        ++range;
+    }
+    return range < ranges_.size() && ranges_[range].offset <= offset;
+}
+
+void IndexBuilder::collect(size_t segment) {
+    if (segment >= num_segments_) return;
+    
+    Segment& out = segments_[segment];
+    uint64_t begin = static_cast<uint64_t>(segment) * segment_size_;
+    size_t range = std::partition_point(ranges_.begin(), ranges_.end(), [&](const ByteRange& r) {
+        return r.end() < begin + chunk_size_;
+    }) - ranges_.begin();
+    auto push = [&](uint64_t hash) {
+        out.hashes.push_back(static_cast<uint32_t>(hash) & HASH_BITS);
+        out.tags.push_back(BlockMatcher::hash_to_tag(hash));
+        ++out.entries;
+    };
+    
+    if (matcher_.winnow_ > 0) {
+        // 第 i 个窗口的选中位置不小于 i，可能越过段末尾，与下一段的重复由 finish 去掉
+        size_t w = matcher_.winnow_;
+        size_t span = std::min(w, positions_);
+        size_t windows = positions_ - span + 1;
+        size_t first = std::min<uint64_t>(begin, windows);
+        size_t last = std::min<uint64_t>(begin + segment_size_, windows);
+        size_t expected = 2 * (last - first) / (w + 1) + 16;
+        out.base = begin;
+        out.offsets.reserve(expected);
+        out.hashes.reserve(expected);
+        out.tags.reserve(expected);
+        winnow_range(data_, chunk_size_, w, span, first, last, [&](uint64_t offset, uint64_t hash) {
+            if (!skipped(range, offset)) {
+                out.offsets.push_back(static_cast<uint32_t>(offset - begin));
+                push(hash);
+            }
+        });
+    } else {
+        size_t step = matcher_.step_;
+        uint64_t first = (begin + step - 1) / step * step;
+        uint64_t last = std::min<uint64_t>(begin + segment_size_, positions_);
+        if (first >= last) return;
+        size_t expected = static_cast<size_t>((last - first + step - 1) / step);
+        out.base = first;
+        out.hashes.reserve(expected);
+        out.tags.reserve(expected);
         
-        hash = hasher.hash();
-        bucket = hash_to_bucket(hash);
-        
-        if (hash_table_[bucket].size() < 200) {  // 增加桶容量
-            hash_table_[bucket].push_back(i);
+        IndexHash hasher(chunk_size_);
+        bool rolled = false;
+        uint64_t prev = 0;
+        for (uint64_t offset = first; offset < last; offset += step) {
+            if (skipped(range, offset)) {
+                out.hashes.push_back(SKIPPED_ENTRY);
+                out.tags.push_back(0);
+                rolled = false;
+                continue;
+            }
+            if (!rolled || offset - prev >= chunk_size_) {
+                rolled = true;
+                hasher.init(data_ + offset, chunk_size_);
+            } else {
+                // 滚动计算 (从上一个采样位置前进到 offset)
+                for (uint64_t i = prev; i < offset; ++i) {
+                    hasher.roll(data_[i], data_[i + chunk_size_]);
+                }
+            }
+            prev = offset;
+            push(hasher.hash());
         }
     }
 }
 
-void BlockMatcher::build_index_parallel(const byte* data, size_t size, size_t chunk_size, int num_threads) {
-    // 单线程版本先清空
-    for (auto& bucket : hash_table_) {
-        bucket.clear();
+void IndexBuilder::finish() {
+    BlockMatcher& m = matcher_;
+    if (chunk_size_ == 0 || size_ < chunk_size_) {
+        // 数据不足一个窗口: 没有条目，仍生成只有一个空桶的有效索引 (可照常保存为索引文件，查询时没有候选)
+        m.bucket_starts_.assign(2, 0);
+        m.bucket_mask_ = 0;
+        m.index_.bucket_starts = m.bucket_starts_.data();
+        m.index_.num_buckets = 1;
+        m.index_.num_entries = 0;
+        return;
     }
     
-    if (size < chunk_size) return;
+    // winnowing 时相邻两段可能选中同一个位置 (采样条目全局升序)，后一段跳过不大于前面最后一个条目的偏移
+    std::vector<size_t> firsts(segments_.size(), 0);
+    size_t indexed_entries = 0;
+    bool has_last = false;
+    uint64_t last = 0;
+    for (size_t k = 0; k < segments_.size(); ++k) {
+        const Segment& segment = segments_[k];
+        size_t first = 0;
+        if (k < num_segments_ && m.winnow_ > 0) {
+            while (has_last && first < segment.offsets.size() && segment.base + segment.offsets[first] <= last) {
+                ++first;
+            }
+            if (first < segment.offsets.size()) {
+                has_last = true;
+                last = segment.base + segment.offsets.back();
+            }
+        }
+        firsts[k] = first;
+        indexed_entries += segment.entries - first;
+    }
     
-    // 确定线程数
-    if (num_threads <= 0) {
-        num_threads = static_cast<int>(std::thread::hardware_concurrency());
-        if (num_threads <= 0) num_threads = 4;
+    // 桶数随条目数增长 (2 的幂)，保持桶短小、候选集中
+    size_t num_buckets = 65536;
+    while (num_buckets * BlockMatcher::BUCKET_LOAD < indexed_entries) {
+        num_buckets <<= 1;
     }
+    m.bucket_mask_ = num_buckets - 1;
     
-    // 确定采样步长
-    size_t step = 1;
-    if (size > 100 * 1024 * 1024) step = 4;
-    if (size > 1024 * 1024 * 1024) step = 8;
+    // 桶按编号划分为若干分区，每个分区的桶计数与条目可放入 L2 缓存
+    size_t buckets_per_part = std::min(num_buckets, static_cast<size_t>(BlockMatcher::BUCKETS_PER_PARTITION));
+    size_t num_parts = num_buckets / buckets_per_part;
+    size_t part_shift = 0;
+    while ((size_t(1) << part_shift) < buckets_per_part) {
+        ++part_shift;
+    }
     
-    // 分块处理
-    size_t chunk_size_bytes = size / num_threads;
-    std::vector<std::vector<std::pair<uint64_t, size_t>>> local_results(num_threads);
+    // 各段按顺序分给线程，每个线程独立统计各分区的条目数
+    int num_threads = num_threads_;
+    size_t per_thread = (segments_.size() + num_threads - 1) / num_threads;
+    std::vector<std::vector<size_t>> part_counts(num_threads, std::vector<size_t>(num_parts, 0));
     
-    // 并行计算哈希
-    std::vector<std::thread> threads;
-    for (int t = 0; t < num_threads; ++t) {
-        threads.emplace_back([&, t]() {
-            size_t start = t * chunk_size_bytes;
-            size_t end = (t == num_threads - 1) ? size : (t + 1) * chunk_size_bytes;
-            if (end + chunk_size > size) end = size - chunk_size;
-            
-            auto& results = local_results[t];
-            results.reserve((end - start) / step / num_threads);
+    auto for_each_slice = [&](auto&& fn) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            size_t begin = std::min(segments_.size(), t * per_thread);
+            size_t end = std::min(segments_.size(), begin + per_thread);
+            threads.emplace_back([&fn, t, begin, end]() { fn(t, begin, end); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+    
+    // 1. 统计每个分区的条目数
+    for_each_slice([&](int t, size_t begin, size_t end) {
+        auto& counts = part_counts[t];
+        for (size_t k = begin; k < end; ++k) {
+            const auto& hashes = segments_[k].hashes;
+            for (size_t e = firsts[k]; e < hashes.size(); ++e) {
+                if (hashes[e] != SKIPPED_ENTRY) {
+                    ++counts[(hashes[e] & m.bucket_mask_) >> part_shift];
+                }
+            }
+        }
+    });
+    
+    // 2. 按 (分区, 线程) 顺序计算写入位置，稳定地把条目分发到各分区
+    std::vector<size_t> part_starts(num_parts + 1, 0);
+    size_t total = 0;
+    for (size_t p = 0; p < num_parts; ++p) {
+        part_starts[p] = total;
+        for (int t = 0; t < num_threads; ++t) {
+            size_t count = part_counts[t][p];
+            part_counts[t][p] = total;
+            total += count;
+        }
+    }
+    part_starts[num_parts] = total;
+    
+    struct PartEntry {
+        uint32_t bucket;
+        uint32_t offset_lo;     // 偏移的低 32 位 (高 8 位另存)
+    };
+    std::vector<PartEntry> part_entries(indexed_entries);
+    std::vector<uint8_t> part_tags(indexed_entries);
+    bool wide_offsets = size_ > (uint64_t(1) << 32);
+    std::vector<uint8_t> part_offsets_hi(wide_offsets ? indexed_entries : 0);
+    
+    for_each_slice([&](int t, size_t begin, size_t end) {
+        auto& cursors = part_counts[t];
+        for (size_t k = begin; k < end; ++k) {
+            Segment& segment = segments_[k];
+            for (size_t e = firsts[k]; e < segment.hashes.size(); ++e) {
+                if (segment.hashes[e] == SKIPPED_ENTRY) {
+                    continue;
+                }
+                uint32_t bucket = static_cast<uint32_t>(segment.hashes[e] & m.bucket_mask_);
+                size_t slot = cursors[bucket >> part_shift]++;
+                uint64_t offset = entry_offset(segment, e);
+                part_tags[slot] = segment.tags[e];
+                part_entries[slot] = {bucket, static_cast<uint32_t>(offset)};
+                if (wide_offsets) {
+                    part_offsets_hi[slot] = static_cast<uint8_t>(offset >> 32);
+                }
+            }
+            // 分发完的段立即释放
+            segment = Segment{};
+        }
+    });
+    std::vector<Segment>().swap(segments_);
+    
+    // 3. 各分区内计数排序，生成桶起始位置与偏移 (桶内保持条目顺序)
+    m.bucket_starts_.resize(num_buckets + 1);
+    m.offsets_lo_.resize(indexed_entries);
+    m.tags_.resize(indexed_entries);
+    if (wide_offsets) {
+        m.offsets_hi_.resize(indexed_entries);
+    }
+    
+    parallel_for(num_parts, num_threads, [&](size_t first_part, size_t last_part) {
+        std::vector<uint32_t> cursors(buckets_per_part);
+        for (size_t p = first_part; p < last_part; ++p) {
+            size_t first_bucket = p * buckets_per_part;
+            std::fill(cursors.begin(), cursors.end(), 0);
+            for (size_t i = part_starts[p]; i < part_starts[p + 1]; ++i) {
+                ++cursors[part_entries[i].bucket - first_bucket];
+            }
             
-            RollingHash hasher(chunk_size);
+            uint32_t pos = static_cast<uint32_t>(part_starts[p]);
+            for (size_t b = 0; b < buckets_per_part; ++b) {
+                m.bucket_starts_[first_bucket + b] = pos;
+                uint32_t count = cursors[b];
+                cursors[b] = pos;
+                pos += count;
+            }
             
-            for (size_t i = start; i < end; i += step) {
-                if (i + chunk_size > size) break;
-                
-                if (i == start) {
-                    hasher.init(data + i, chunk_size);
-                } else {
-                    // 滚动计算
-                    for (size_t j = 0; j < step && i + j + chunk_size <= size; ++j) {
-                        hasher.roll(data[i + j - 1], data[i + j + chunk_size - 1]);
-                    }
+            for (size_t i = part_starts[p]; i < part_starts[p + 1]; ++i) {
+                uint32_t slot = cursors[part_entries[i].bucket - first_bucket]++;
+                uint64_t offset = part_entries[i].offset_lo;
+                if (wide_offsets) {
+                    offset |= static_cast<uint64_t>(part_offsets_hi[i]) << 32;
+                }
+                m.offsets_lo_[slot] = static_cast<uint32_t>(offset);
+                m.tags_[slot] = part_tags[i];
+                if (wide_offsets) {
+                    m.offsets_hi_[slot] = static_cast<uint8_t>(offset >> 32);
                 }
-                
-                results.emplace_back(hasher.hash(), i);
             }
-        });
-    }
+        }
+    });
+    m.bucket_starts_[num_buckets] = static_cast<uint32_t>(indexed_entries);
     
-    // 等待所有线程完成
-    for (auto& thread : threads) {
-        thread.join();
+    m.index_.bucket_starts = m.bucket_starts_.data();
+    m.index_.offsets_lo = m.offsets_lo_.data();
+    m.index_.offsets_hi = wide_offsets ? m.offsets_hi_.data() : nullptr;
+    m.index_.tags = m.tags_.data();
+    m.index_.num_buckets = num_buckets;
+    m.index_.num_entries = indexed_entries;
+}
+
+uint64_t BlockMatcher::compute_chunk_hash(const byte* data, size_t size) const {
+    return IndexHash::compute(data, size);
+}
+
+// ============== MatchCursor 实现 ==============
+
+MatchCursor::MatchCursor(
+    const BlockMatcher& matcher,
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size
+)
+    : matcher_(matcher)
+    , old_data_(old_data)
+    , old_size_(old_size)
+    , new_data_(new_data)
+    , new_size_(new_size)
+    , window_(matcher.min_match())
+    , hasher_(matcher.min_match())
+    , rolled_(false)
+    , pos_(0)
+    , front_(0)
+    , skip_(1)
+    , ring_{}
+{
+}
+
+void MatchCursor::seek(size_t pos) {
+    if (pos < pos_ || pos > front_) {
+        // 后退或跳过了已计算的区域: 丢弃预先计算的哈希
+        // winnowing 判定需要 pos 之前一个窗口的哈希，从那里重新开始计算
+        size_t behind = matcher_.winnow_ > 0 ? matcher_.winnow_ - 1 : 0;
+        rolled_ = false;
+        front_ = pos - std::min(pos, behind);
     }
+    pos_ = pos;
+}
+
+void MatchCursor::fill_ahead(size_t end) {
+    if (new_size_ < window_) return;
+    end = std::min(end, new_size_ - window_ + 1);
+    bool indexed = matcher_.has_index();
     
-    // 合并结果到哈希表
-    for (const auto& local : local_results) {
-        for (const auto& [hash, offset] : local) {
-            size_t bucket = hash_to_bucket(hash);
-            if (hash_table_[bucket].size() < 200) {
-                hash_table_[bucket].push_back(offset);
+    for (; front_ < end; ++front_) {
+        if (rolled_) {
+            hasher_.roll(new_data_[front_ - 1], new_data_[front_ + window_ - 1]);
+        } else {
+            hasher_.init(new_data_ + front_, window_);
+            rolled_ = true;
+        }
+        
+        uint64_t hash = hasher_.hash();
+        ring_[front_ % RING_SIZE] = hash;
+        
+        // 跳过的位置不会被查询，不为它们预取 (随机内容上逐字节预取本身就占满内存带宽)
+        if (indexed && (skip_ == 1 || (front_ - pos_) % skip_ == 0)) {
+            matcher_.prefetch_bucket(hash);
+            if (front_ >= pos_ + PREFETCH_DISTANCE) {
+                matcher_.prefetch_candidates(ring_[(front_ - PREFETCH_DISTANCE) % RING_SIZE]);
             }
         }
     }
 }
 
-uint64_t BlockMatcher::compute_chunk_hash(const byte* data, size_t size) {
-    return RollingHash::compute(data, size);
+bool MatchCursor::winnowed(size_t pos) const {
+    // 与建索引相同的规则: 存在包含 pos 的完整窗口，窗口内 pos 之后的哈希都更大、之前的都不小于它
+    size_t w = matcher_.winnow_;
+    size_t last = new_size_ - window_;
+    size_t need = std::min(w, last + 1);
+    uint64_t hash = ring_[pos % RING_SIZE];
+    
+    size_t right = 0;
+    while (right + 1 < need && pos + right + 1 <= last && ring_[(pos + right + 1) % RING_SIZE] > hash) {
+        ++right;
+    }
+    size_t left = 0;
+    while (left + right + 1 < need && pos > left && ring_[(pos - left - 1) % RING_SIZE] >= hash) {
+        ++left;
+    }
+    return left + right + 1 >= need;
+}
+
+size_t MatchCursor::scan_skip(size_t misses) const {
+    size_t skip = std::min(1 + misses / SKIP_TRIGGER, MAX_SKIP);
+    while (std::gcd(skip, matcher_.step_) != 1) {
+        --skip;
+    }
+    return skip;
+}
+
+Match MatchCursor::find() {
+    if (!has_window()) {
+        return Match{};
+    }
+    if (!matcher_.has_index()) {
+        return matcher_.scan_without_index(old_data_, old_size_, new_data_, new_size_, pos_);
+    }
+    
+    fill_ahead(pos_ + 1);
+    return matcher_.probe_index(ring_[pos_ % RING_SIZE], old_data_, old_size_, new_data_, new_size_, pos_);
 }
 
-size_t BlockMatcher::hash_to_bucket(uint64_t hash) const {
-    return static_cast<size_t>(hash % HASH_BUCKETS);
+Match MatchCursor::scan(size_t limit) {
+    if (!matcher_.has_index()) {
+        for (; has_window() && pos_ < limit; advance()) {
+            auto match = find();
+            if (match.valid()) {
+                return match;
+            }
+        }
+        return Match{};
+    }
+    
+    // winnowing 索引已只在选中位置查询，不再跳过
+    // 固定步长索引在随机/已压缩内容上几乎每次查询都落空，连续未命中后拉大间隔；
+    // 长度至少 min_match + skip * step 的匹配仍必定被某次查询命中
+    bool winnowing = matcher_.winnow_ > 0;
+    size_t misses = 0;
+    skip_ = 1;
+    for (; has_window() && pos_ < limit; pos_ += skip_) {
+        // 保持 LOOKAHEAD 个位置的哈希已算好，对应桶已在预取中
+        fill_ahead(pos_ + LOOKAHEAD);
+        if (winnowing && !winnowed(pos_)) {
+            continue;
+        }
+        auto match = matcher_.probe_index(
+            ring_[pos_ % RING_SIZE], old_data_, old_size_, new_data_, new_size_, pos_
+        );
+        if (match.valid()) {
+            // 命中前跳过的位置补查一遍，保持停在最早的匹配起点 (哈希仍在环形缓冲中)
+            for (size_t pos = pos_ - skip_ + 1; pos < pos_; ++pos) {
+                auto earlier = matcher_.probe_index(
+                    ring_[pos % RING_SIZE], old_data_, old_size_, new_data_, new_size_, pos
+                );
+                if (earlier.valid()) {
+                    pos_ = pos;
+                    return earlier;
+                }
+            }
+            return match;
+        }
+        if (!winnowing && ++misses % SKIP_TRIGGER == 0) {
+            skip_ = scan_skip(misses);
+        }
+    }
+    return Match{};
 }
 
 } // namespace bindiff
@@ -3,6 +3,54 @@
 
 namespace bindiff {
 
+namespace {
+
+// ============== 变长整数 (LEB128 / zigzag) ==============
+
+constexpr size_t MAX_VARINT_BYTES = 10;
+
+void put_varint(uint64_t value, std::vector<byte>& output) {
+    while (value >= 0x80) {
+        output.push_back(static_cast<byte>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<byte>(value));
+}
+
+// 返回读取的字节数，0 表示数据不完整或超长
+size_t get_varint(const byte* data, size_t size, uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < size && i < MAX_VARINT_BYTES; ++i) {
+        value |= static_cast<uint64_t>(data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// 读取不超过 32 位的长度
+size_t get_length(const byte* data, size_t size, uint32_t& length) {
+    uint64_t value;
+    size_t read = get_varint(data, size, value);
+    if (read == 0 || value > UINT32_MAX) {
+        return 0;
+    }
+    length = static_cast<uint32_t>(value);
+    return read;
+}
+
+// 有符号差值映射为无符号数，绝对值小的差值编码也短
+inline uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+} // namespace
+
 // ============== OperationSerializer 实现 ==============
 
 void OperationSerializer::serialize(const Operation& op, std::vector<byte>& output) {
@@ -18,14 +66,36 @@ void OperationSerializer::serialize(const Operation& op, std::vector<byte>& outp
         for (int i = 0; i < 4; ++i) {
             output.push_back(static_cast<byte>(op.copy_length >> (i * 8)));
         }
+    } else if (op.opcode == OpCode::COPY_NEW) {
+        // 写入块内 offset 与 length
+        for (int i = 0; i < 4; ++i) {
+            output.push_back(static_cast<byte>(op.copy_offset >> (i * 8)));
+        }
+        for (int i = 0; i < 4; ++i) {
+            output.push_back(static_cast<byte>(op.copy_length >> (i * 8)));
+        }
+    } else if (op.opcode == OpCode::ADD) {
+        // 写入 offset、length 与差值
+        for (int i = 0; i < 8; ++i) {
+            output.push_back(static_cast<byte>(op.copy_offset >> (i * 8)));
+        }
+        for (int i = 0; i < 4; ++i) {
+            output.push_back(static_cast<byte>(op.data_length >> (i * 8)));
+        }
+        output.insert(output.end(), op.data, op.data + op.data_length);
+    } else if (op.opcode == OpCode::FILL) {
+        // 写入 value 与 length
+        output.push_back(op.fill_value);
+        for (int i = 0; i < 4; ++i) {
+            output.push_back(static_cast<byte>(op.fill_length >> (i * 8)));
+        }
     } else {
         // 写入 length
-        uint32_t len = static_cast<uint32_t>(op.insert_data.size());
         for (int i = 0; i < 4; ++i) {
-            output.push_back(static_cast<byte>(len >> (i * 8)));
+            output.push_back(static_cast<byte>(op.data_length >> (i * 8)));
         }
         // 写入 data
-        output.insert(output.end(), op.insert_data.begin(), op.insert_data.end());
+        output.insert(output.end(), op.data, op.data + op.data_length);
     }
 }
 
@@ -55,7 +125,45 @@ size_t OperationSerializer::deserialize(
         }
         
         read = 13;
-    } else {
+    } else if (op.opcode == OpCode::COPY_NEW) {
+        if (size < 1 + 4 + 4) return 0;
+        
+        op.copy_offset = 0;
+        op.copy_length = 0;
+        for (int i = 0; i < 4; ++i) {
+            op.copy_offset |= static_cast<uint64_t>(data[1 + i]) << (i * 8);
+            op.copy_length |= static_cast<uint32_t>(data[5 + i]) << (i * 8);
+        }
+        
+        read = 9;
+    } else if (op.opcode == OpCode::ADD) {
+        if (size < 1 + 8 + 4) return 0;
+        
+        op.copy_offset = 0;
+        op.copy_length = 0;
+        for (int i = 0; i < 8; ++i) {
+            op.copy_offset |= static_cast<uint64_t>(data[1 + i]) << (i * 8);
+        }
+        for (int i = 0; i < 4; ++i) {
+            op.copy_length |= static_cast<uint32_t>(data[9 + i]) << (i * 8);
+        }
+        
+        if (size - 13 < op.copy_length) return 0;
+        
+        op.data = data + 13;
+        op.data_length = op.copy_length;
+        read = 13 + op.copy_length;
+    } else if (op.opcode == OpCode::FILL) {
+        if (size < 1 + 1 + 4) return 0;
+        
+        op.fill_value = data[1];
+        op.fill_length = 0;
+        for (int i = 0; i < 4; ++i) {
+            op.fill_length |= static_cast<uint32_t>(data[2 + i]) << (i * 8);
+        }
+        
+        read = 6;
+    } else if (op.opcode == OpCode::INSERT) {
         if (size < 1 + 4) return 0;
         
         // 读取 length
@@ -66,9 +174,147 @@ size_t OperationSerializer::deserialize(
         
         if (size < 1 + 4 + len) return 0;
         
-        // 读取 data
-        op.insert_data.assign(data + 5, data + 5 + len);
+        // data 指向输入中的数据，不复制
+        op.data = data + 5;
+        op.data_length = len;
         read = 5 + len;
+    } else {
+        return 0;  // 未知操作码
+    }
+    
+    return read;
+}
+
+void OperationSerializer::serialize(const Operation& op, OperationContext& context, std::vector<byte>& output) {
+    encode(op, context, output, output, output);
+}
+
+void OperationSerializer::serialize(const Operation& op, OperationContext& context, OperationStreams& streams) {
+    encode(op, context, streams.control, streams.literals, streams.diffs);
+}
+
+size_t OperationSerializer::deserialize(
+    const byte* data,
+    size_t size,
+    Operation& op,
+    OperationContext& context
+) {
+    return decode(data, size, op, context, nullptr, nullptr);
+}
+
+size_t OperationSerializer::deserialize(
+    const byte* control,
+    size_t size,
+    Operation& op,
+    OperationContext& context,
+    StreamCursor& literals,
+    StreamCursor& diffs
+) {
+    return decode(control, size, op, context, &literals, &diffs);
+}
+
+void OperationSerializer::encode(
+    const Operation& op,
+    OperationContext& context,
+    std::vector<byte>& control,
+    std::vector<byte>& literals,
+    std::vector<byte>& diffs
+) {
+    control.push_back(static_cast<byte>(op.opcode));
+    
+    if (op.opcode == OpCode::COPY || op.opcode == OpCode::ADD) {
+        // 旧文件偏移相对上一个 COPY / ADD 的终点，顺序复制时差值为 0
+        put_varint(zigzag_encode(static_cast<int64_t>(op.copy_offset - context.old_position)), control);
+        put_varint(op.copy_length, control);
+        if (op.opcode == OpCode::ADD) {
+            diffs.insert(diffs.end(), op.data, op.data + op.data_length);
+        }
+        context.old_position = op.copy_offset + op.copy_length;
+        context.output_position += op.copy_length;
+    } else if (op.opcode == OpCode::COPY_NEW) {
+        // 来源记为向前的距离
+        put_varint(context.output_position - op.copy_offset, control);
+        put_varint(op.copy_length, control);
+        context.output_position += op.copy_length;
+    } else if (op.opcode == OpCode::FILL) {
+        control.push_back(op.fill_value);
+        put_varint(op.fill_length, control);
+        context.output_position += op.fill_length;
+    } else {
+        put_varint(op.data_length, control);
+        literals.insert(literals.end(), op.data, op.data + op.data_length);
+        context.output_position += op.data_length;
+    }
+}
+
+size_t OperationSerializer::decode(
+    const byte* data,
+    size_t size,
+    Operation& op,
+    OperationContext& context,
+    StreamCursor* literals,
+    StreamCursor* diffs
+) {
+    if (size < 1) return 0;
+    
+    op.opcode = static_cast<OpCode>(data[0]);
+    size_t read = 1;
+    size_t n;
+    
+    // INSERT 数据 / ADD 差值: 分流时从各自的流读取，否则紧跟在字段之后
+    auto take_payload = [&](StreamCursor* stream, size_t length) -> const byte* {
+        if (stream) {
+            return stream->take(length);
+        }
+        if (size - read < length) return nullptr;
+        read += length;
+        return data + read - length;
+    };
+    
+    if (op.opcode == OpCode::COPY || op.opcode == OpCode::ADD) {
+        uint64_t delta;
+        if ((n = get_varint(data + read, size - read, delta)) == 0) return 0;
+        read += n;
+        if ((n = get_length(data + read, size - read, op.copy_length)) == 0) return 0;
+        read += n;
+        
+        op.copy_offset = context.old_position + static_cast<uint64_t>(zigzag_decode(delta));
+        if (op.opcode == OpCode::ADD) {
+            const byte* payload = take_payload(diffs, op.copy_length);
+            if (!payload) return 0;
+            op.data = payload;
+            op.data_length = op.copy_length;
+        }
+        context.old_position = op.copy_offset + op.copy_length;
+        context.output_position += op.copy_length;
+    } else if (op.opcode == OpCode::COPY_NEW) {
+        uint64_t distance;
+        if ((n = get_varint(data + read, size - read, distance)) == 0) return 0;
+        read += n;
+        if ((n = get_length(data + read, size - read, op.copy_length)) == 0) return 0;
+        read += n;
+        
+        if (distance > context.output_position) return 0;
+        op.copy_offset = context.output_position - distance;
+        context.output_position += op.copy_length;
+    } else if (op.opcode == OpCode::FILL) {
+        if (size < 2) return 0;
+        op.fill_value = data[1];
+        read = 2;
+        if ((n = get_length(data + read, size - read, op.fill_length)) == 0) return 0;
+        read += n;
+        context.output_position += op.fill_length;
+    } else if (op.opcode == OpCode::INSERT) {
+        uint32_t len;
+        if ((n = get_length(data + read, size - read, len)) == 0) return 0;
+        read += n;
+        const byte* payload = take_payload(literals, len);
+        if (!payload) return 0;
+        op.data = payload;
+        op.data_length = len;
+        context.output_position += len;
+    } else {
+        return 0;  // 未知操作码
     }
     
     return read;
@@ -76,17 +322,39 @@ size_t OperationSerializer::deserialize(
 
 void OperationSerializer::serialize_all(
     const std::vector<Operation>& ops,
-    std::vector<byte>& output
+    std::vector<byte>& output,
+    uint16_t format_version
 ) {
     output.clear();
     
-    // 预分配空间
+    // 预分配空间 (按 v1 大小预估)
     size_t total = total_size(ops);
     output.reserve(total);
     
     // 序列化每个操作
+    if (format_version == OP_FORMAT_V1) {
+        for (const auto& op : ops) {
+            serialize(op, output);
+        }
+    } else {
+        OperationContext context;
+        for (const auto& op : ops) {
+            serialize(op, context, output);
+        }
+    }
+}
+
+void OperationSerializer::serialize_all(
+    const std::vector<Operation>& ops,
+    OperationStreams& streams
+) {
+    streams.control.clear();
+    streams.literals.clear();
+    streams.diffs.clear();
+    
+    OperationContext context;
     for (const auto& op : ops) {
-        serialize(op, output);
+        serialize(op, context, streams);
     }
 }
 
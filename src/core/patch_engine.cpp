@@ -2,14 +2,96 @@
 #include "core/patch_format.hpp"
 #include "core/operations.hpp"
 #include "core/block_processor.hpp"
+#include "io/async_file.hpp"
 #include "io/stream_writer.hpp"
 #include "crypto/sha256.hpp"
+#include "utils/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <chrono>
 #include <cstring>
+#include <new>
+#include <thread>
 
 namespace bindiff {
 
+namespace {
+
+// 留作空洞的最小零区间 (按文件系统块对齐后)
+constexpr uint64_t SPARSE_MIN_LENGTH = 64 * KB;
+constexpr uint64_t SPARSE_ALIGN = 4 * KB;
+static_assert(SPARSE_ALIGN % AsyncFile::DIRECT_ALIGN == 0, "空洞边界须满足直接 I/O 的对齐");
+
+// 零区间 (相对块起点) 内可留作空洞的文件区间，过短时返回 false
+bool sparse_hole(uint64_t block_start, const ByteRange& fill, uint64_t& hole_begin, uint64_t& hole_end) {
+    hole_begin = (block_start + fill.offset + SPARSE_ALIGN - 1) / SPARSE_ALIGN * SPARSE_ALIGN;
+    hole_end = (block_start + fill.end()) / SPARSE_ALIGN * SPARSE_ALIGN;
+    return hole_end >= hole_begin + SPARSE_MIN_LENGTH;
+}
+
+// 块中实际写出的区间 (相对块起点)，zero_fills 中足够长的零区间跳过不写
+// 输出文件新建且已扩展到最终大小，未写入的部分读出即为零 (支持稀疏文件的文件系统上不占空间)
+std::vector<ByteRange> data_ranges(uint64_t block_start, size_t size, const std::vector<ByteRange>& zero_fills) {
+    std::vector<ByteRange> ranges;
+    uint64_t written = 0;
+    for (const auto& fill : zero_fills) {
+        uint64_t hole_begin, hole_end;
+        if (!sparse_hole(block_start, fill, hole_begin, hole_end)) {
+            continue;
+        }
+        if (hole_begin - block_start > written) {
+            ranges.push_back({written, hole_begin - block_start - written});
+        }
+        written = hole_end - block_start;
+    }
+    if (size > written) {
+        ranges.push_back({written, size - written});
+    }
+    return ranges;
+}
+
+// 单个读写请求的最大长度: 大块拆成多个请求，队列中同时有多个请求在途
+constexpr size_t IO_CHUNK = 4 * MB;
+
+// 已读入、尚未重建完成的补丁数据上限 (至少预读一块)
+constexpr uint64_t READ_AHEAD_LIMIT = 256 * MB;
+
+// 只增不减的块缓冲区 (不初始化，逐块复用)
+// 按直接 I/O 的要求对齐，容量取整到对齐单位，文件末尾不足一个单位的部分可以补齐写出
+struct BlockBuffer {
+    struct Free {
+        void operator()(uint8_t* p) const { ::operator delete[](p, std::align_val_t(AsyncFile::DIRECT_ALIGN)); }
+    };
+    std::unique_ptr<uint8_t[], Free> data;
+    size_t capacity = 0;
+    
+    void reserve(size_t size) {
+        if (size > capacity) {
+            size = (size + AsyncFile::DIRECT_ALIGN - 1) / AsyncFile::DIRECT_ALIGN * AsyncFile::DIRECT_ALIGN;
+            data.reset(static_cast<uint8_t*>(::operator new[](size, std::align_val_t(AsyncFile::DIRECT_ALIGN))));
+            capacity = size;
+        }
+    }
+};
+
+// 拆分提交 [offset, offset + length) 的读写请求，返回请求数 (失败时返回 0)
+size_t submit_chunked(AsyncFile& file, bool write, uint8_t* buffer, size_t length, uint64_t offset, uint64_t tag) {
+    size_t requests = 0;
+    for (size_t done = 0; done < length; done += IO_CHUNK) {
+        size_t n = std::min(IO_CHUNK, length - done);
+        bool ok = write ? file.submit_write(buffer + done, n, offset + done, tag)
+                        : file.submit_read(buffer + done, n, offset + done, tag);
+        if (!ok) {
+            return 0;
+        }
+        ++requests;
+    }
+    return requests;
+}
+
+} // namespace
+
 // ============== PatchEngine 实现 ==============
 
 PatchEngine::PatchEngine(const PatchOptions& options)
@@ -69,8 +151,9 @@ Result PatchEngine::apply_patch(
     if (callback) {
         callback->on_progress(0.2f, "应用补丁");
     }
-    if (!reconstruct_all_blocks(old_file, patch_path, new_path, callback)) {
-        result.error = "重建文件失败";
+    std::string error;
+    if (!reconstruct_all_blocks(old_file, patch_path, new_path, callback, error)) {
+        result.error = error.empty() ? "重建文件失败" : "重建文件失败: " + error;
         return result;
     }
     
@@ -128,83 +211,336 @@ bool PatchEngine::reconstruct_all_blocks(
     MMapFile& old_file,
     const std::string& patch_path,
     const std::string& output_path,
-    ProgressCallback* callback
+    ProgressCallback* callback,
+    std::string& error
 ) {
-    std::ifstream patch_file(patch_path, std::ios::binary);
-    if (!patch_file) {
-        return false;
+    const uint32_t num_blocks = patch_info_.num_blocks;
+    
+    // 每块在补丁中的状态。声明在文件与线程池之前: 析构时先停止线程池、等待在途 I/O，再释放缓冲区
+    struct PendingBlock {
+        BlockBuffer payload;                 // 块在补丁中的数据 (含块头)
+        size_t reads_left = 0;
+        std::future<bool> result;
+        BlockBuffer output;                  // 未映射输出时的块缓冲区，写出完成前保留
+        size_t output_size = 0;
+        std::vector<ByteRange> zero_fills;
+        size_t writes_left = 0;
+    };
+    std::vector<PendingBlock> blocks(num_blocks);
+    std::vector<uint64_t> spans(num_blocks);
+    // 用完的缓冲区留给后面的块，避免每块重新分配 (大块的首次写入缺页开销明显)
+    std::vector<BlockBuffer> spare_payloads;
+    std::vector<BlockBuffer> spare_outputs;
+    BlockProcessor processor(patch_info_.block_size, 1);
+    
+    // 新建输出文件并预分配大小，之后各块只覆盖写入自己的区间
+    // 优先映射输出文件，块直接重建到最终位置；否则 (或要求直接 I/O 时) 由主线程按偏移写出
+    // 只在空间已预分配时映射: 未预分配的映射写入时磁盘满只会 SIGBUS，按偏移写出则报告 ENOSPC
+    MMapFile mapped_output;
+    std::unique_ptr<AsyncFile> writer;
+    bool use_mapping = options_.mmap_output && !options_.direct_output && patch_info_.new_size > 0 &&
+                       mapped_output.create(output_path, patch_info_.new_size);
+    if (use_mapping && !mapped_output.preallocated()) {
+        mapped_output.close();
+        use_mapping = false;
+    }
+    if (!use_mapping) {
+        // 直接 I/O 要求块起点对齐 (空洞边界与块内的请求随之对齐，只有文件末尾须补齐)
+        bool direct = options_.direct_output && patch_info_.block_size % AsyncFile::DIRECT_ALIGN == 0;
+        writer = AsyncFile::open(output_path, direct ? AsyncFile::Mode::WriteDirect : AsyncFile::Mode::Write,
+                                 options_.io, error);
+        if (!writer) {
+            return false;
+        }
+        if (!writer->resize(patch_info_.new_size)) {
+            error = writer->error();  // 磁盘空间不足
+            return false;
+        }
     }
     
-    std::ofstream output(output_path, std::ios::binary);
-    if (!output) {
+    auto reader = AsyncFile::open(patch_path, AsyncFile::Mode::Read, options_.io, error);
+    if (!reader) {
         return false;
     }
     
-    // 预分配文件大小
-    if (patch_info_.new_size > 0) {
-        output.seekp(patch_info_.new_size - 1);
-        output.put(0);
-        if (!output) {
-            return false;  // 磁盘空间不足或写入失败
+    // 块数据的范围: 到下一块的起点 (最后一块到文件末尾)
+    uint64_t patch_size = reader->size();
+    for (uint32_t i = 0; i < num_blocks; ++i) {
+        uint64_t begin = block_offsets_[i];
+        uint64_t end = i + 1 < num_blocks ? block_offsets_[i + 1] : patch_size;
+        if (end > patch_size || end < begin || end - begin < 2 * sizeof(uint32_t)) {
+            return false;
         }
-        output.seekp(0);
+        spans[i] = end - begin;
     }
     
-    // 创建块处理器
-    BlockProcessor processor(patch_info_.block_size, 1);
+    // 块之间互不依赖 (只读原文件)，由线程池并行重建
+    int threads = options_.num_threads;
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads <= 0) threads = 4;
+    }
+    threads = static_cast<int>(std::min<uint64_t>(threads, std::max<uint32_t>(num_blocks, 1)));
+    ThreadPool pool(threads);
+    std::atomic<bool> failed{false};
     
-    // 处理每个块
-    std::vector<uint8_t> output_buffer;
-    output_buffer.reserve(patch_info_.block_size);
+    // 主线程流水线: 预读补丁数据 → 读完的块按顺序交给线程池 → 按顺序收集结果并写出
+    // 在途的重建任务不超过线程数的两倍；未映射输出时块缓冲区为每线程一块、另加一块写出中的，
+    // 缓冲区用完时先等写出完成
+    const uint32_t max_tasks = static_cast<uint32_t>(threads) * 2;
+    const size_t max_outputs = static_cast<size_t>(threads) + 1;
+    uint32_t next_read = 0, next_task = 0, next_done = 0;
+    uint32_t writing = 0;
+    size_t outputs = 0;
+    uint64_t buffered = 0;
     
-    for (uint32_t i = 0; i < patch_info_.num_blocks; ++i) {
-        // 读取块偏移
-        patch_file.seekg(block_offsets_[i]);
-        
-        // 读取原始大小
-        uint32_t original_size;
-        patch_file.read(reinterpret_cast<char*>(&original_size), sizeof(original_size));
-        
-        // 读取压缩后大小
-        uint32_t compressed_size;
-        patch_file.read(reinterpret_cast<char*>(&compressed_size), sizeof(compressed_size));
-        
-        // 读取压缩数据
-        std::vector<uint8_t> compressed_data(compressed_size);
-        if (compressed_size > 0) {
-            patch_file.read(reinterpret_cast<char*>(compressed_data.data()), compressed_size);
+    // 中途失败: 排队中的任务不再重建；读写失败时带上原因 (如写出时磁盘空间不足)
+    auto abort = [&]() {
+        failed.store(true, std::memory_order_relaxed);
+        if (writer && !writer->error().empty()) {
+            error = writer->error();
+        } else if (!reader->error().empty()) {
+            error = reader->error();
         }
-        
-        // 计算块输出大小
-        uint64_t block_start = static_cast<uint64_t>(i) * patch_info_.block_size;
-        size_t block_output_size = static_cast<size_t>(std::min(
-            static_cast<uint64_t>(patch_info_.block_size),
-            patch_info_.new_size - block_start
-        ));
-        
-        // 重建块
-        output_buffer.resize(block_output_size);
-        if (!processor.reconstruct_block(
-            i,
-            old_file.data(), static_cast<size_t>(old_file.size()),
-            compressed_data,
-            original_size,
-            output_buffer.data(),
-            block_output_size
-        )) {
+        return false;
+    };
+    auto take_buffer = [](std::vector<BlockBuffer>& spare, BlockBuffer& buffer, size_t size) {
+        if (!spare.empty()) {
+            buffer = std::move(spare.back());
+            spare.pop_back();
+        }
+        buffer.reserve(size);
+    };
+    auto wait_read = [&]() {
+        uint64_t tag;
+        if (!reader->wait_one(tag)) {
+            return false;
+        }
+        --blocks[tag].reads_left;
+        return true;
+    };
+    // 要求直接 I/O 却按普通写入时: 写完的块开始写回，上一个写完的块写回后移出页缓存
+    bool has_cached = false;
+    uint32_t cached_block = 0;
+    auto block_range = [&](uint32_t index, uint64_t& start, uint64_t& length) {
+        start = static_cast<uint64_t>(index) * patch_info_.block_size;
+        length = std::min<uint64_t>(patch_info_.block_size, patch_info_.new_size - start);
+    };
+    auto release_cache = [&](uint32_t index) {
+        if (!options_.direct_output || writer->direct()) {
+            return;
+        }
+        uint64_t start, length;
+        block_range(index, start, length);
+        writer->start_writeback(start, length);
+        if (has_cached) {
+            block_range(cached_block, start, length);
+            writer->drop_cache(start, length);
+        }
+        has_cached = true;
+        cached_block = index;
+    };
+    auto wait_write = [&]() {
+        uint64_t tag;
+        if (!writer->wait_one(tag)) {
             return false;
         }
+        if (--blocks[tag].writes_left == 0) {
+            spare_outputs.push_back(std::move(blocks[tag].output));
+            --writing;
+            release_cache(static_cast<uint32_t>(tag));
+        }
+        return true;
+    };
+    
+    while (next_done < num_blocks) {
+        // 预读: 未收集的块不超过 max_tasks + 2 块、已缓冲的数据不超过上限 (下一个待启动的块总会读入)
+        while (next_read < num_blocks &&
+               (next_read == next_task ||
+                (next_read - next_done < max_tasks + 2 && buffered + spans[next_read] <= READ_AHEAD_LIMIT))) {
+            PendingBlock& block = blocks[next_read];
+            take_buffer(spare_payloads, block.payload, static_cast<size_t>(spans[next_read]));
+            block.reads_left = submit_chunked(*reader, false, block.payload.data.get(), spans[next_read],
+                                              block_offsets_[next_read], next_read);
+            if (block.reads_left == 0) {
+                return abort();
+            }
+            buffered += spans[next_read];
+            ++next_read;
+        }
+        if (!reader->submit()) {
+            return abort();
+        }
         
-        // 写入输出
-        output.seekp(block_start);
-        output.write(reinterpret_cast<char*>(output_buffer.data()), block_output_size);
+        // 启动读完的块
+        bool can_launch = next_task < next_read && next_task - next_done < max_tasks;
+        if (can_launch && writer && spare_outputs.empty() && outputs >= max_outputs) {
+            if (writing > 0) {
+                if (!wait_write()) {
+                    return abort();
+                }
+                continue;
+            }
+            can_launch = false;
+        }
+        if (can_launch) {
+            if (blocks[next_task].reads_left > 0) {
+                if (!wait_read()) {
+                    return abort();
+                }
+                continue;
+            }
+            
+            // 块输出范围 (块数与文件头中的新文件大小不符时拒绝，不写出文件范围)
+            uint32_t i = next_task++;
+            uint64_t block_start = static_cast<uint64_t>(i) * patch_info_.block_size;
+            if (block_start > patch_info_.new_size) {
+                return abort();
+            }
+            size_t output_size = static_cast<size_t>(std::min(
+                static_cast<uint64_t>(patch_info_.block_size),
+                patch_info_.new_size - block_start
+            ));
+            uint8_t* output = nullptr;
+            if (use_mapping) {
+                output = mapped_output.data() + block_start;
+            } else {
+                if (spare_outputs.empty()) {
+                    ++outputs;
+                }
+                take_buffer(spare_outputs, blocks[i].output, output_size);
+                blocks[i].output_size = output_size;
+                output = blocks[i].output.data.get();
+            }
+            
+            blocks[i].result = pool.submit([&, i, output, output_size]() {
+                // 已有块失败时不再处理其余块
+                if (failed.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                PendingBlock& block = blocks[i];
+                bool ok = reconstruct_block_at(processor, old_file, i, block.payload.data.get(), spans[i],
+                                               output, output_size, use_mapping ? &mapped_output : nullptr,
+                                               block.zero_fills);
+                if (!ok) {
+                    failed.store(true, std::memory_order_relaxed);
+                }
+                return ok;
+            });
+            continue;
+        }
+        
+        // 按块顺序收集结果
+        PendingBlock& block = blocks[next_done];
+        bool ok = block.result.get();
+        buffered -= spans[next_done];
+        spare_payloads.push_back(std::move(block.payload));
+        if (!ok) {
+            return abort();
+        }
+        if (writer) {
+            uint64_t block_start = static_cast<uint64_t>(next_done) * patch_info_.block_size;
+            for (const auto& range : data_ranges(block_start, block.output_size, block.zero_fills)) {
+                // 直接 I/O: 文件末尾补齐到对齐单位 (缓冲区容量已取整)，全部写完后截掉
+                size_t length = static_cast<size_t>(range.length);
+                if (writer->direct()) {
+                    length = (length + AsyncFile::DIRECT_ALIGN - 1) / AsyncFile::DIRECT_ALIGN * AsyncFile::DIRECT_ALIGN;
+                }
+                size_t requests = submit_chunked(*writer, true, block.output.data.get() + range.offset,
+                                                 length, block_start + range.offset, next_done);
+                if (requests == 0) {
+                    return abort();
+                }
+                block.writes_left += requests;
+            }
+            if (!writer->submit()) {
+                return abort();
+            }
+            if (block.writes_left > 0) {
+                ++writing;
+            } else {
+                spare_outputs.push_back(std::move(block.output));
+            }
+        }
+        ++next_done;
         
         if (callback) {
-            float progress = 0.2f + 0.7f * (i + 1) / patch_info_.num_blocks;
+            float progress = 0.2f + 0.7f * next_done / num_blocks;
             callback->on_progress(progress, "应用补丁");
         }
     }
     
+    if (!writer) {
+        // 写回映射并取得写回错误 (如 EIO)，否则错误只在之后被静默丢弃
+        if (!mapped_output.flush()) {
+            error = mapped_output.error();
+            return false;
+        }
+        return true;
+    }
+    while (writing > 0) {
+        if (!wait_write()) {
+            return abort();
+        }
+    }
+    if (has_cached) {
+        uint64_t start, length;
+        block_range(cached_block, start, length);
+        writer->drop_cache(start, length);
+    }
+    if (options_.direct_output && !writer->resize(patch_info_.new_size)) {
+        error = writer->error();
+        return false;
+    }
+    return true;
+}
+
+bool PatchEngine::reconstruct_block_at(
+    BlockProcessor& processor,
+    const MMapFile& old_file,
+    uint32_t index,
+    const uint8_t* block_data,
+    size_t block_data_size,
+    uint8_t* output,
+    size_t output_size,
+    MMapFile* mapped_output,
+    std::vector<ByteRange>& zero_fills
+) {
+    // 块头: 原始大小与压缩后大小
+    uint32_t original_size;
+    uint32_t compressed_size;
+    const size_t header_size = sizeof(original_size) + sizeof(compressed_size);
+    std::memcpy(&original_size, block_data, sizeof(original_size));
+    std::memcpy(&compressed_size, block_data + sizeof(original_size), sizeof(compressed_size));
+    if (compressed_size > block_data_size - header_size) {
+        return false;
+    }
+    
+    zero_fills.clear();
+    if (!processor.reconstruct_block(
+        index,
+        old_file.data(), static_cast<size_t>(old_file.size()),
+        block_data + header_size, compressed_size,
+        original_size,
+        output,
+        output_size,
+        options_.sparse_output ? &zero_fills : nullptr,
+        patch_info_.version,
+        mapped_output != nullptr
+    )) {
+        return false;
+    }
+    
+    // 映射输出: 新建的映射读出为零，FILL 0 未写入；足够长的零区间再释放预分配的空间，留作空洞
+    if (mapped_output) {
+        uint64_t block_start = static_cast<uint64_t>(index) * patch_info_.block_size;
+        for (const auto& fill : zero_fills) {
+            uint64_t hole_begin, hole_end;
+            if (sparse_hole(block_start, fill, hole_begin, hole_end)) {
+                mapped_output->punch_hole(hole_begin, hole_end - hole_begin);
+            }
+        }
+    }
     return true;
 }
 
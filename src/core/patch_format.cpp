@@ -4,7 +4,7 @@
 namespace bindiff {
 
 bool PatchHeader::is_valid() const {
-    return std::memcmp(magic, MAGIC, 4) == 0 && version == VERSION;
+    return std::memcmp(magic, MAGIC, 4) == 0 && version >= MIN_VERSION && version <= VERSION;
 }
 
 void PatchHeader::init(uint32_t blk_size, uint64_t old_sz, uint64_t new_sz) {
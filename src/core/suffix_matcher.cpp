@@ -0,0 +1,379 @@
+#include "core/suffix_matcher.hpp"
+#include "core/match_length.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace bindiff {
+
+namespace {
+
+// ============== SA-IS 后缀数组构建 ==============
+
+// 小规模输入直接排序
+template <typename Char>
+void sa_naive(const Char* s, int32_t n, int32_t* sa) {
+    for (int32_t i = 0; i < n; ++i) {
+        sa[i] = i;
+    }
+    std::sort(sa, sa + n, [&](int32_t a, int32_t b) {
+        if (a == b) return false;
+        while (a < n && b < n) {
+            if (s[a] != s[b]) return s[a] < s[b];
+            ++a;
+            ++b;
+        }
+        return a == n;
+    });
+}
+
+// 诱导排序 (Nong, Zhang & Chan 2009)
+// s: 输入串，字符取值 [0, upper]；sa: 输出 (长度 n)
+// 递归子问题与 LMS 子串命名都复用 sa 的空闲部分，额外内存约为 n/8 + 4 * (LMS 数)
+template <typename Char>
+void sa_is(const Char* s, int32_t n, int32_t upper, int32_t* sa) {
+    if (n < 16) {
+        sa_naive(s, n, sa);
+        return;
+    }
+
+    // ls[i] = true 表示 S 型后缀
+    std::vector<bool> ls(n, false);
+    for (int32_t i = n - 2; i >= 0; --i) {
+        ls[i] = (s[i] == s[i + 1]) ? ls[i + 1] : (s[i] < s[i + 1]);
+    }
+    auto is_lms = [&](int32_t i) {
+        return i > 0 && ls[i] && !ls[i - 1];
+    };
+
+    // 桶边界: sum_l[c] 为字符 c 的 L 型起点，sum_s[c] 为 S 型起点
+    std::vector<int32_t> sum_l(upper + 2, 0), sum_s(upper + 2, 0);
+    for (int32_t i = 0; i < n; ++i) {
+        if (!ls[i]) {
+            sum_s[s[i]]++;
+        } else {
+            sum_l[s[i] + 1]++;
+        }
+    }
+    for (int32_t i = 0; i <= upper; ++i) {
+        sum_s[i] += sum_l[i];
+        if (i < upper) sum_l[i + 1] += sum_s[i];
+    }
+
+    std::vector<int32_t> buf(upper + 2);
+    auto induce = [&](const std::vector<int32_t>& lms) {
+        std::fill(sa, sa + n, -1);
+        std::copy(sum_s.begin(), sum_s.end(), buf.begin());
+        for (int32_t d : lms) {
+            sa[buf[s[d]]++] = d;
+        }
+        std::copy(sum_l.begin(), sum_l.end(), buf.begin());
+        sa[buf[s[n - 1]]++] = n - 1;
+        for (int32_t i = 0; i < n; ++i) {
+            int32_t v = sa[i];
+            if (v >= 1 && !ls[v - 1]) {
+                sa[buf[s[v - 1]]++] = v - 1;
+            }
+        }
+        std::copy(sum_l.begin(), sum_l.end(), buf.begin());
+        for (int32_t i = n - 1; i >= 0; --i) {
+            int32_t v = sa[i];
+            if (v >= 1 && ls[v - 1]) {
+                sa[--buf[s[v - 1] + 1]] = v - 1;
+            }
+        }
+    };
+
+    // 收集 LMS 位置 (文本顺序)
+    std::vector<int32_t> lms;
+    for (int32_t i = 1; i < n; ++i) {
+        if (is_lms(i)) lms.push_back(i);
+    }
+    int32_t m = static_cast<int32_t>(lms.size());
+
+    induce(lms);
+
+    if (m == 0) {
+        return;
+    }
+
+    // 排序后的 LMS 位置紧缩到 sa[0, m)
+    int32_t sorted = 0;
+    for (int32_t i = 0; i < n; ++i) {
+        int32_t v = sa[i];
+        if (v >= 0 && is_lms(v)) sa[sorted++] = v;
+    }
+
+    // 为 LMS 子串命名: LMS 位置间隔至少为 2，名字暂存于 sa[m + pos / 2]
+    std::fill(sa + m, sa + n, -1);
+    int32_t rec_upper = 0;
+    sa[m + (sa[0] >> 1)] = 0;
+    for (int32_t i = 1; i < m; ++i) {
+        int32_t l = sa[i - 1], r = sa[i];
+        bool same = false;
+        for (int32_t d = 0;; ++d) {
+            if (l + d == n || r + d == n ||
+                s[l + d] != s[r + d] || ls[l + d] != ls[r + d]) {
+                break;
+            }
+            if (d > 0 && (is_lms(l + d) || is_lms(r + d))) {
+                same = is_lms(l + d) && is_lms(r + d);
+                break;
+            }
+        }
+        if (!same) rec_upper++;
+        sa[m + (r >> 1)] = rec_upper;
+    }
+
+    // 名字按文本顺序紧缩到 sa 尾部，构成递归子问题
+    int32_t* rec_s = sa + n - m;
+    for (int32_t i = n - 1, j = n; i >= m; --i) {
+        if (sa[i] >= 0) sa[--j] = sa[i];
+    }
+
+    // 递归结果写入 sa[0, m)；名字互不相同时直接得出顺序
+    if (rec_upper + 1 < m) {
+        sa_is(rec_s, m, rec_upper, sa);
+    } else {
+        for (int32_t i = 0; i < m; ++i) {
+            sa[rec_s[i]] = i;
+        }
+    }
+
+    for (int32_t i = 0; i < m; ++i) {
+        sa[i] = lms[sa[i]];
+    }
+    std::copy(sa, sa + m, lms.begin());
+    induce(lms);
+}
+
+} // namespace
+
+// ============== SuffixMatcher 实现 ==============
+
+SuffixMatcher::SuffixMatcher(size_t min_match, size_t sample_step)
+    : min_match_(min_match)
+    , sample_step_(sample_step > 0 ? sample_step : std::max<size_t>(min_match / 4, 1))
+{
+}
+
+void SuffixMatcher::build(const byte* data, size_t size, int num_threads, size_t segment_size) {
+    segments_.clear();
+    suffix_array_.clear();
+    if (size == 0) {
+        return;
+    }
+
+    if (segment_size == 0) segment_size = DEFAULT_SEGMENT_SIZE;
+    segment_size = std::min(segment_size, MAX_SEGMENT_SIZE - SEGMENT_OVERLAP);
+    size_t overlap = std::min(SEGMENT_OVERLAP, segment_size / 4);
+
+    // 每段覆盖到下一段的重叠区之后；剩余部分过短时并入本段，避免产生只有几个字节的段
+    size_t total = 0;
+    for (size_t begin = 0; ; begin += segment_size) {
+        size_t end = std::min(size, begin + segment_size + overlap);
+        if (size - end < segment_size / 4 && size - begin <= MAX_SEGMENT_SIZE) {
+            end = size;
+        }
+        segments_.push_back({begin, end - begin, total, 0, {}});
+        total += end - begin;
+        if (end == size) {
+            break;
+        }
+    }
+
+    suffix_array_.resize(total);
+
+    // 各段相互独立，按段分配给工作线程
+    size_t threads = std::max(1, num_threads);
+    threads = std::min(threads, segments_.size());
+
+    std::atomic<size_t> next_segment{0};
+    auto worker = [&]() {
+        for (size_t s = next_segment++; s < segments_.size(); s = next_segment++) {
+            const Segment& seg = segments_[s];
+            int32_t* sa = reinterpret_cast<int32_t*>(suffix_array_.data() + seg.sa_begin);
+            sa_is(data + seg.begin, static_cast<int32_t>(seg.size), 255, sa);
+            build_buckets(segments_[s], data);
+        }
+    };
+
+    if (threads <= 1) {
+        worker();
+    } else {
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < threads; ++t) {
+            pool.emplace_back(worker);
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+}
+
+uint32_t SuffixMatcher::prefix_key(const byte* p, size_t len, size_t prefix_bytes) {
+    // 不足 prefix_bytes 的短后缀按 0 补齐，恰好排在对应桶的最前面
+    uint32_t key = 0;
+    for (size_t i = 0; i < prefix_bytes; ++i) {
+        key = (key << 8) | (i < len ? p[i] : 0);
+    }
+    return key;
+}
+
+void SuffixMatcher::build_buckets(Segment& segment, const byte* data) {
+    const byte* text = data + segment.begin;
+    segment.prefix_bytes = segment.size >= LARGE_PREFIX_MIN_SEGMENT ? 3 : 2;
+    size_t num_buckets = size_t(1) << (8 * segment.prefix_bytes);
+    
+    segment.buckets.assign(num_buckets + 1, 0);
+    for (size_t i = 0; i < segment.size; ++i) {
+        segment.buckets[prefix_key(text + i, segment.size - i, segment.prefix_bytes) + 1]++;
+    }
+    for (size_t k = 0; k < num_buckets; ++k) {
+        segment.buckets[k + 1] += segment.buckets[k];
+    }
+}
+
+size_t SuffixMatcher::index_memory() const {
+    size_t total = suffix_array_.size() * sizeof(uint32_t);
+    for (const auto& segment : segments_) {
+        total += segment.buckets.size() * sizeof(uint32_t);
+    }
+    return total;
+}
+
+Match SuffixMatcher::search_segment(
+    const Segment& segment,
+    const byte* old_data,
+    const byte* key, size_t key_len
+) const {
+    const byte* text = old_data + segment.begin;
+    const uint32_t* sa = suffix_array_.data() + segment.sa_begin;
+
+    // 不变式: suffix(sa[lo]) < key <= suffix(sa[hi])，lo = -1 / hi = size 为哨兵
+    // lo_lcp / hi_lcp 为 key 与两端后缀的公共前缀长度，比较时跳过二者较小值
+    // 先用前缀桶缩小区间，桶为空时该段不可能有长度 >= PREFIX_BYTES 的匹配
+    uint32_t key_prefix = prefix_key(key, key_len, segment.prefix_bytes);
+    int64_t lo = static_cast<int64_t>(segment.buckets[key_prefix]) - 1;
+    int64_t hi = static_cast<int64_t>(segment.buckets[key_prefix + 1]);
+    if (hi - lo <= 1) {
+        return Match{};
+    }
+    int64_t bucket_end = hi;
+    size_t lo_lcp = 0, hi_lcp = 0;
+
+    while (hi - lo > 1) {
+        int64_t mid = lo + (hi - lo) / 2;
+        size_t offset = sa[mid];
+        size_t suffix_len = segment.size - offset;
+        size_t skip = std::min(lo_lcp, hi_lcp);
+        size_t limit = std::min(key_len, suffix_len);
+        size_t lcp = skip + match_length(text + offset + skip, key + skip, limit - skip);
+
+        if (lcp == key_len) {
+            // key 是该后缀的前缀，不可能更长
+            return Match{segment.begin + offset, lcp};
+        }
+        if (lcp == suffix_len || text[offset + lcp] < key[lcp]) {
+            lo = mid;
+            lo_lcp = lcp;
+        } else {
+            hi = mid;
+            hi_lcp = lcp;
+        }
+    }
+
+    // 最长公共前缀必出现在插入点两侧的相邻后缀中
+    Match match;
+    if (lo >= static_cast<int64_t>(segment.buckets[key_prefix]) && lo_lcp >= hi_lcp) {
+        match = Match{segment.begin + sa[lo], lo_lcp};
+    } else if (hi < bucket_end) {
+        match = Match{segment.begin + sa[hi], hi_lcp};
+    }
+    return match;
+}
+
+Match SuffixMatcher::find_longest_match(
+    const byte* old_data, size_t old_size,
+    const byte* new_data, size_t new_size,
+    size_t new_offset,
+    size_t min_length
+) const {
+    if (min_length == 0) {
+        min_length = min_match_;
+    }
+    Match best;
+    if (new_offset + min_match_ > new_size) {
+        return best;
+    }
+
+    // 使用完整的剩余数据作为查找键，保证得到真正的最长匹配
+    // (如零填充区，截断的键只能命中任意一个位置)
+    const byte* key = new_data + new_offset;
+    size_t key_len = new_size - new_offset;
+
+    for (const auto& segment : segments_) {
+        Match match = search_segment(segment, old_data, key, key_len);
+
+        // 段内比较在重叠区末尾截止，更长的部分用完整数据继续向后扩展
+        if (match.length > 0 && match.old_offset + match.length == segment.begin + segment.size) {
+            size_t limit = std::min(old_size - match.old_offset, key_len);
+            match.length += match_length(old_data + match.old_offset + match.length,
+                                         key + match.length, limit - match.length);
+        }
+
+        if (match.length > best.length) {
+            best = match;
+        }
+        if (best.length == key_len) {
+            break;
+        }
+    }
+
+    if (best.length < min_length) {
+        return Match{};
+    }
+    return best;
+}
+
+// ============== SuffixCursor 实现 ==============
+
+SuffixCursor::SuffixCursor(const SuffixMatcher& matcher,
+                           const byte* old_data, size_t old_size,
+                           const byte* new_data, size_t new_size)
+    : matcher_(matcher)
+    , old_data_(old_data)
+    , old_size_(old_size)
+    , new_data_(new_data)
+    , new_size_(new_size)
+{
+}
+
+Match SuffixCursor::find() const {
+    return matcher_.find_longest_match(old_data_, old_size_, new_data_, new_size_, pos_);
+}
+
+Match SuffixCursor::scan(size_t limit) {
+    size_t step = matcher_.sample_step();
+    size_t min_match = matcher_.min_match();
+    size_t min_length = min_match > step - 1 ? min_match - (step - 1) : 1;
+    size_t start = pos_;
+    if (pos_ % step != 0) {
+        pos_ += step - pos_ % step;
+    }
+    while (has_window() && pos_ < limit) {
+        Match match = matcher_.find_longest_match(old_data_, old_size_, new_data_, new_size_, pos_, min_length);
+        if (match.valid()) {
+            size_t back = match_length_backward(old_data_ + match.old_offset, new_data_ + pos_,
+                                                std::min(match.old_offset, pos_ - start));
+            if (match.length + back >= min_match) {
+                pos_ -= back;
+                return Match{match.old_offset - back, match.length + back};
+            }
+        }
+        pos_ += step;
+    }
+    return Match{};
+}
+
+} // namespace bindiff
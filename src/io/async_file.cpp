@@ -0,0 +1,611 @@
+#include "io/async_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define BINDIFF_HAS_IO_URING 1
+    #endif
+#endif
+
+#if BINDIFF_HAS_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+#endif
+
+namespace bindiff {
+
+namespace {
+
+// ============== 平台相关的文件操作 ==============
+
+#ifdef _WIN32
+
+intptr_t open_handle(const std::string& path, AsyncFile::Mode mode, bool& direct, std::string& error) {
+    bool write = mode != AsyncFile::Mode::Read;
+    direct = mode == AsyncFile::Mode::WriteDirect;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    for (int attempt = direct ? 0 : 1; attempt < 2 && handle == INVALID_HANDLE_VALUE; ++attempt) {
+        handle = CreateFileA(
+            path.c_str(),
+            write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            write ? CREATE_ALWAYS : OPEN_EXISTING,
+            attempt == 0 ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL,
+            nullptr
+        );
+        direct = direct && attempt == 0 && handle != INVALID_HANDLE_VALUE;
+    }
+    if (handle == INVALID_HANDLE_VALUE) {
+        error = (write ? "无法创建文件: " : "无法打开文件: ") + path;
+        return -1;
+    }
+    return reinterpret_cast<intptr_t>(handle);
+}
+
+void close_handle(intptr_t handle) {
+    CloseHandle(reinterpret_cast<HANDLE>(handle));
+}
+
+// 在 offset 处读写 length 字节 (同步)
+bool transfer(intptr_t handle, bool write, byte* buffer, size_t length, uint64_t offset, std::string& error) {
+    while (length > 0) {
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD done = 0;
+        BOOL ok = write ? WriteFile(reinterpret_cast<HANDLE>(handle), buffer, chunk, &done, &overlapped)
+                        : ReadFile(reinterpret_cast<HANDLE>(handle), buffer, chunk, &done, &overlapped);
+        if (!ok || done == 0) {
+            error = write ? "写入文件失败" : "读取文件失败 (超出文件末尾?)";
+            return false;
+        }
+        buffer += done;
+        length -= done;
+        offset += done;
+    }
+    return true;
+}
+
+bool resize_handle(intptr_t handle, uint64_t size) {
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(size);
+    HANDLE h = reinterpret_cast<HANDLE>(handle);
+    return SetFilePointerEx(h, position, nullptr, FILE_BEGIN) && SetEndOfFile(h);
+}
+
+uint64_t handle_size(intptr_t handle) {
+    LARGE_INTEGER size;
+    return GetFileSizeEx(reinterpret_cast<HANDLE>(handle), &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+}
+
+// 打开后不能再关闭无缓冲模式
+bool disable_direct_handle(intptr_t) { return false; }
+
+void start_writeback_handle(intptr_t, uint64_t, uint64_t) {}
+void drop_cache_handle(intptr_t, uint64_t, uint64_t) {}
+
+#else  // Linux/macOS
+
+intptr_t open_handle(const std::string& path, AsyncFile::Mode mode, bool& direct, std::string& error) {
+    bool write = mode != AsyncFile::Mode::Read;
+    direct = false;
+    int fd = write ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                   : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    // 截断后重新打开: ext4 对截断为空的文件在关闭时立即回写全部脏页 (auto_da_alloc)，
+    // 写完整个输出文件后关闭会同步发起大量回写
+    if (write && fd >= 0) {
+        ::close(fd);
+        fd = -1;
+#ifdef O_DIRECT
+        // 文件系统不支持直接 I/O (如 tmpfs) 时打开失败，改为普通写入
+        if (mode == AsyncFile::Mode::WriteDirect) {
+            fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | O_DIRECT);
+            direct = fd >= 0;
+        }
+#endif
+        if (fd < 0) {
+            fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+        // macOS: 不经页缓存，且不要求对齐
+        if (fd >= 0 && mode == AsyncFile::Mode::WriteDirect) {
+            direct = fcntl(fd, F_NOCACHE, 1) != -1;
+        }
+#endif
+    }
+    if (fd < 0) {
+        error = (write ? "无法创建文件: " : "无法打开文件: ") + path + " (" + std::strerror(errno) + ")";
+        return -1;
+    }
+    return fd;
+}
+
+void close_handle(intptr_t handle) {
+    ::close(static_cast<int>(handle));
+}
+
+// 在 offset 处读写 length 字节 (同步，短读写时继续)
+bool transfer(intptr_t handle, bool write, byte* buffer, size_t length, uint64_t offset, std::string& error) {
+    int fd = static_cast<int>(handle);
+    while (length > 0) {
+        ssize_t done = write ? ::pwrite(fd, buffer, length, static_cast<off_t>(offset))
+                             : ::pread(fd, buffer, length, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            error = done == 0 ? std::string("读取文件失败: 超出文件末尾")
+                              : std::string(write ? "写入文件失败: " : "读取文件失败: ") + std::strerror(errno);
+            return false;
+        }
+        buffer += done;
+        length -= static_cast<size_t>(done);
+        offset += static_cast<uint64_t>(done);
+    }
+    return true;
+}
+
+bool resize_handle(intptr_t handle, uint64_t size) {
+    return ftruncate(static_cast<int>(handle), static_cast<off_t>(size)) == 0;
+}
+
+uint64_t handle_size(intptr_t handle) {
+    struct stat st;
+    return fstat(static_cast<int>(handle), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+bool disable_direct_handle(intptr_t handle) {
+    int fd = static_cast<int>(handle);
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags & ~O_DIRECT) != -1;
+#elif defined(F_NOCACHE)
+    return fcntl(fd, F_NOCACHE, 0) != -1;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+void start_writeback_handle(intptr_t handle, uint64_t offset, uint64_t length) {
+#ifdef __linux__
+    sync_file_range(static_cast<int>(handle), static_cast<off_t>(offset), static_cast<off_t>(length),
+                    SYNC_FILE_RANGE_WRITE);
+#else
+    (void)handle; (void)offset; (void)length;
+#endif
+}
+
+void drop_cache_handle(intptr_t handle, uint64_t offset, uint64_t length) {
+    int fd = static_cast<int>(handle);
+#ifdef __linux__
+    // 脏页不会被 DONTNEED 丢弃，先等它们写回
+    sync_file_range(fd, static_cast<off_t>(offset), static_cast<off_t>(length),
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+    (void)fd; (void)offset; (void)length;
+#endif
+}
+
+#endif
+
+// ============== 同步后端 (pread/pwrite) ==============
+
+class SyncFile : public AsyncFile {
+public:
+    SyncFile(intptr_t handle, uint32_t queue_depth, bool direct) : AsyncFile(handle, queue_depth, direct) {}
+
+    bool submit_read(void* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+        return run(false, static_cast<byte*>(buffer), length, offset, tag);
+    }
+
+    bool submit_write(const void* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+        return run(true, const_cast<byte*>(static_cast<const byte*>(buffer)), length, offset, tag);
+    }
+
+    const char* backend_name() const override { return "pread/pwrite"; }
+
+protected:
+    bool reap() override { return false; }  // 请求在提交时已完成
+
+private:
+    bool run(bool write, byte* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        if (failed_) {
+            return false;
+        }
+        std::string message;
+        bool ok = transfer(handle_, write, buffer, length, offset, message);
+        if (!ok && write && direct_ && errno == EINVAL && disable_direct()) {
+            ok = transfer(handle_, write, buffer, length, offset, message);
+        }
+        if (!ok) {
+            return fail(message);
+        }
+        completed_.push_back(tag);
+        return true;
+    }
+};
+
+// ============== io_uring 后端 ==============
+
+#if BINDIFF_HAS_IO_URING
+
+int uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+// 直接使用内核接口 (不依赖 liburing): 提交队列与完成队列均为与内核共享的环形缓冲区
+class UringFile : public AsyncFile {
+public:
+    // 创建失败 (内核不支持、被禁用等) 时返回空并设置 error
+    static std::unique_ptr<UringFile> create(intptr_t handle, uint32_t queue_depth, bool direct, std::string& error) {
+        std::unique_ptr<UringFile> file(new UringFile(handle, queue_depth, direct));
+        if (!file->setup(error)) {
+            file->handle_ = -1;  // 句柄仍归调用方
+            return nullptr;
+        }
+        return file;
+    }
+
+    ~UringFile() override {
+        // 缓冲区由调用方持有，关闭前须等待内核完成全部请求 (包括失败之后仍在途的)
+        while (in_flight_ > 0) {
+            if (harvest() == 0 && !enter(1) && errno != EINTR) {
+                break;
+            }
+        }
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+    }
+
+    bool submit_read(void* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+        return enqueue(false, static_cast<byte*>(buffer), length, offset, tag);
+    }
+
+    bool submit_write(const void* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+        return enqueue(true, const_cast<byte*>(static_cast<const byte*>(buffer)), length, offset, tag);
+    }
+
+    bool submit() override {
+        while (queued_ > 0) {
+            if (!enter(0) && errno != EINTR) {
+                return fail(std::string("io_uring 提交失败: ") + std::strerror(errno));
+            }
+        }
+        return !failed_;
+    }
+
+    const char* backend_name() const override { return "io_uring"; }
+
+protected:
+    // 排队的请求与等待在同一次 io_uring_enter 中完成
+    bool reap() override {
+        while (harvest() == 0) {
+            if (in_flight_ == 0) {
+                return false;
+            }
+            if (!enter(1) && errno != EINTR) {
+                return fail(std::string("io_uring 等待失败: ") + std::strerror(errno));
+            }
+        }
+        return !failed_;
+    }
+
+private:
+    struct Request {
+        byte* buffer;
+        size_t length;
+        size_t done;          // 已完成的字节数 (短读写时从这里续传)
+        uint64_t offset;
+        uint64_t tag;
+        bool write;
+        struct iovec iov;     // 须在请求完成前保持有效
+    };
+
+    UringFile(intptr_t handle, uint32_t queue_depth, bool direct) : AsyncFile(handle, queue_depth, direct) {}
+
+    bool setup(std::string& error) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd_ = uring_setup(queue_depth_, &params);
+        if (ring_fd_ < 0) {
+            error = std::string("io_uring 不可用: ") + std::strerror(errno);
+            return false;
+        }
+
+        // 提交队列、完成队列与 SQE 数组映射到用户空间 (新内核上两个队列共用一次映射)
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+        sq_ptr_ = map_ring(sq_size_, IORING_OFF_SQ_RING);
+        cq_ptr_ = single_mmap ? sq_ptr_ : map_ring(cq_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map_ring(sqes_size_, IORING_OFF_SQES));
+        if (!sq_ptr_ || !cq_ptr_ || !sqes_) {
+            error = std::string("io_uring 映射失败: ") + std::strerror(errno);
+            return false;
+        }
+
+        auto* sq = static_cast<byte*>(sq_ptr_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* cq = static_cast<byte*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        requests_.resize(queue_depth_);
+        for (uint32_t slot = queue_depth_; slot > 0; --slot) {
+            free_slots_.push_back(slot - 1);
+        }
+        return true;
+    }
+
+    // 处理完成队列中已有的条目，返回处理的个数
+    unsigned harvest() {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            complete(static_cast<uint32_t>(cqe.user_data), cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    // 提交全部排队的 SQE，min_complete > 0 时同时等待完成
+    bool enter(unsigned min_complete) {
+        int submitted = uring_enter(ring_fd_, queued_, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (submitted < 0) {
+            return false;
+        }
+        queued_ -= static_cast<unsigned>(submitted);
+        return true;
+    }
+
+    void* map_ring(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    bool enqueue(bool write, byte* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        if (failed_) {
+            return false;
+        }
+        if (length == 0) {
+            completed_.push_back(tag);
+            return true;
+        }
+        // 队列已满: 先等待一个请求完成
+        while (free_slots_.empty()) {
+            if (!reap()) {
+                return false;
+            }
+        }
+        uint32_t slot = free_slots_.back();
+        free_slots_.pop_back();
+        requests_[slot] = Request{buffer, length, 0, offset, tag, write, {}};
+        ++in_flight_;
+        push(slot);
+        return true;
+    }
+
+    void release(uint32_t slot) {
+        --in_flight_;
+        free_slots_.push_back(slot);
+    }
+
+    // 为请求剩余的部分填写一个 SQE 并排队 (每个请求至多一个 SQE 在提交队列中，队列不会溢出)
+    void push(uint32_t slot) {
+        Request& request = requests_[slot];
+        request.iov.iov_base = request.buffer + request.done;
+        request.iov.iov_len = request.length - request.done;
+
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & *sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe.fd = static_cast<int>(handle_);
+        sqe.addr = reinterpret_cast<uint64_t>(&request.iov);
+        sqe.len = 1;
+        sqe.off = request.offset + request.done;
+        sqe.user_data = slot;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++queued_;
+    }
+
+    void complete(uint32_t slot, int32_t result) {
+        Request& request = requests_[slot];
+        if (result == -EINTR || result == -EAGAIN ||
+            (result == -EINVAL && request.write && direct_ && disable_direct())) {
+            push(slot);
+            return;  // 重新排队
+        } else if (result > 0) {
+            request.done += static_cast<size_t>(result);
+            if (request.done == request.length) {
+                completed_.push_back(request.tag);
+            } else {
+                push(slot);
+                return;  // 短读写: 续传剩余部分
+            }
+        } else if (result == 0) {
+            fail("读取文件失败: 超出文件末尾");
+        } else {
+            fail(std::string(request.write ? "写入文件失败: " : "读取文件失败: ") + std::strerror(-result));
+        }
+        release(slot);
+    }
+
+    int ring_fd_ = -1;
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned queued_ = 0;           // 已写入提交队列、尚未交给内核的 SQE 数
+    std::vector<Request> requests_;
+    std::vector<uint32_t> free_slots_;
+};
+
+#endif
+
+} // namespace
+
+// ============== AsyncFile 实现 ==============
+
+const char* io_backend_name(IoBackend backend) {
+    switch (backend) {
+        case IoBackend::Auto:    return "auto";
+        case IoBackend::IoUring: return "io_uring";
+        case IoBackend::Sync:    return "sync";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<AsyncFile> AsyncFile::open(
+    const std::string& path,
+    Mode mode,
+    const IoOptions& options,
+    std::string& error
+) {
+    bool direct = false;
+    intptr_t handle = open_handle(path, mode, direct, error);
+    if (handle < 0) {
+        return nullptr;
+    }
+    uint32_t depth = std::max<uint32_t>(options.queue_depth, 1);
+
+#if BINDIFF_HAS_IO_URING
+    if (options.backend != IoBackend::Sync) {
+        std::string uring_error;
+        auto file = UringFile::create(handle, depth, direct, uring_error);
+        if (file) {
+            return file;
+        }
+        if (options.backend == IoBackend::IoUring) {
+            close_handle(handle);
+            error = uring_error;
+            return nullptr;
+        }
+    }
+#else
+    if (options.backend == IoBackend::IoUring) {
+        close_handle(handle);
+        error = "本平台不支持 io_uring";
+        return nullptr;
+    }
+#endif
+    return std::unique_ptr<AsyncFile>(new SyncFile(handle, depth, direct));
+}
+
+AsyncFile::AsyncFile(intptr_t handle, uint32_t queue_depth, bool direct)
+    : handle_(handle)
+    , queue_depth_(queue_depth)
+    , direct_(direct)
+{
+}
+
+AsyncFile::~AsyncFile() {
+    if (handle_ >= 0) {
+        close_handle(handle_);
+    }
+}
+
+bool AsyncFile::wait_one(uint64_t& tag) {
+    while (completed_.empty()) {
+        if (failed_ || in_flight_ == 0 || !reap()) {
+            return false;
+        }
+    }
+    tag = completed_.front();
+    completed_.pop_front();
+    return !failed_;
+}
+
+bool AsyncFile::wait_all() {
+    uint64_t tag;
+    while (pending() > 0) {
+        if (!wait_one(tag)) {
+            return false;
+        }
+    }
+    return !failed_;
+}
+
+bool AsyncFile::resize(uint64_t size) {
+    if (!resize_handle(handle_, size)) {
+        return fail("无法设置文件大小 (磁盘空间不足?)");
+    }
+    return true;
+}
+
+uint64_t AsyncFile::size() const {
+    return handle_size(handle_);
+}
+
+void AsyncFile::start_writeback(uint64_t offset, uint64_t length) {
+    start_writeback_handle(handle_, offset, length);
+}
+
+void AsyncFile::drop_cache(uint64_t offset, uint64_t length) {
+    drop_cache_handle(handle_, offset, length);
+}
+
+bool AsyncFile::disable_direct() {
+    if (!disable_direct_handle(handle_)) {
+        return false;
+    }
+    direct_ = false;
+    return true;
+}
+
+bool AsyncFile::fail(const std::string& message) {
+    if (!failed_) {
+        error_ = message;
+    }
+    failed_ = true;
+    return false;
+}
+
+} // namespace bindiff
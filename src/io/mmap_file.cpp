@@ -1,5 +1,6 @@
 #include "io/mmap_file.hpp"
 #include <system_error>
+#include <cerrno>
 #include <cstring>
 
 #ifdef _WIN32
@@ -21,6 +22,7 @@ MMapFile::MMapFile()
     , mapping_(nullptr)
     , data_(nullptr)
     , size_(0)
+    , preallocated_(false)
 {
 }
 
@@ -33,12 +35,14 @@ MMapFile::MMapFile(MMapFile&& other) noexcept
     , mapping_(other.mapping_)
     , data_(other.data_)
     , size_(other.size_)
+    , preallocated_(other.preallocated_)
     , error_(std::move(other.error_))
 {
     other.handle_ = nullptr;
     other.mapping_ = nullptr;
     other.data_ = nullptr;
     other.size_ = 0;
+    other.preallocated_ = false;
 }
 
 MMapFile& MMapFile::operator=(MMapFile&& other) noexcept {
@@ -48,12 +52,14 @@ MMapFile& MMapFile::operator=(MMapFile&& other) noexcept {
         mapping_ = other.mapping_;
         data_ = other.data_;
         size_ = other.size_;
+        preallocated_ = other.preallocated_;
         error_ = std::move(other.error_);
         
         other.handle_ = nullptr;
         other.mapping_ = nullptr;
         other.data_ = nullptr;
         other.size_ = 0;
+        other.preallocated_ = false;
     }
     return *this;
 }
@@ -63,9 +69,7 @@ bool MMapFile::open(const std::string& path) {
 }
 
 bool MMapFile::create(const std::string& path, uint64_t size) {
-    // TODO: 实现可写映射
-    error_ = "可写映射尚未实现";
-    return false;
+    return create_file(path, size);
 }
 
 void MMapFile::close() {
@@ -83,16 +87,38 @@ byte_view MMapFile::view(uint64_t offset, size_t length) const {
 bool MMapFile::flush() {
 #ifdef _WIN32
     if (data_ && mapping_) {
-        return FlushViewOfFile(data_, 0) != FALSE;
+        if (!FlushViewOfFile(data_, 0) || !FlushFileBuffers(handle_)) {
+            error_ = "同步映射失败";
+            return false;
+        }
+        return true;
     }
 #else
     if (data_) {
-        return msync(data_, size_, MS_SYNC) == 0;
+        if (msync(data_, size_, MS_SYNC) < 0) {
+            error_ = "同步映射失败: " + std::string(std::strerror(errno));
+            return false;
+        }
+        return true;
     }
 #endif
     return false;
 }
 
+bool MMapFile::punch_hole(uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+    if (data_ && handle_ && offset + length <= size_) {
+        int fd = static_cast<int>(reinterpret_cast<intptr_t>(handle_));
+        return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                         static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+    }
+#else
+    (void)offset;
+    (void)length;
+#endif
+    return false;
+}
+
 // ============== 平台相关实现 ==============
 
 #ifdef _WIN32
@@ -159,6 +185,60 @@ bool MMapFile::map_file(const std::string& path, bool read_only) {
     return true;
 }
 
+bool MMapFile::create_file(const std::string& path, uint64_t size) {
+    close();
+    
+    HANDLE hFile = CreateFileA(
+        path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    
+    if (hFile == INVALID_HANDLE_VALUE) {
+        error_ = "无法创建文件: " + path;
+        return false;
+    }
+    
+    // 设置大小 (NTFS 上相当于预留空间)
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(hFile, fileSize, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+        CloseHandle(hFile);
+        error_ = "无法设置文件大小 (磁盘空间不足?)";
+        return false;
+    }
+    size_ = size;
+    preallocated_ = true;
+    
+    if (size_ == 0) {
+        handle_ = hFile;
+        return true;
+    }
+    
+    HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (!hMap) {
+        CloseHandle(hFile);
+        error_ = "无法创建文件映射";
+        return false;
+    }
+    
+    data_ = static_cast<byte*>(MapViewOfFile(hMap, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    if (!data_) {
+        CloseHandle(hMap);
+        CloseHandle(hFile);
+        error_ = "无法映射文件视图";
+        return false;
+    }
+    
+    handle_ = hFile;
+    mapping_ = hMap;
+    return true;
+}
+
 bool MMapFile::unmap_file() {
     bool success = true;
     
@@ -180,6 +260,7 @@ bool MMapFile::unmap_file() {
     }
     
     size_ = 0;
+    preallocated_ = false;
     return success;
 }
 
@@ -237,6 +318,60 @@ bool MMapFile::map_file(const std::string& path, bool read_only) {
     return true;
 }
 
+bool MMapFile::create_file(const std::string& path, uint64_t size) {
+    close();
+    
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error_ = "无法创建文件: " + path + " (" + std::strerror(errno) + ")";
+        return false;
+    }
+    
+    // 预分配空间；文件系统不支持时退回为只设置大小 (之后写入映射时才分配)
+    bool sized = false;
+#if defined(__linux__)
+    if (size > 0) {
+        int err = posix_fallocate(fd, 0, static_cast<off_t>(size));
+        if (err == 0) {
+            sized = true;
+        } else if (err != EOPNOTSUPP && err != EINVAL) {
+            ::close(fd);
+            error_ = "无法预分配文件空间: " + std::string(std::strerror(err));
+            return false;
+        }
+    }
+#endif
+    if (!sized && ftruncate(fd, static_cast<off_t>(size)) < 0) {
+        int err = errno;
+        ::close(fd);
+        error_ = "无法设置文件大小: " + std::string(std::strerror(err));
+        return false;
+    }
+    size_ = size;
+    preallocated_ = sized || size == 0;
+    
+    if (size_ == 0) {
+        handle_ = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+        data_ = nullptr;
+        return true;
+    }
+    
+    // 共享映射: 写入直接进入页缓存，由内核写回文件
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        size_ = 0;
+        preallocated_ = false;
+        error_ = "无法映射文件: " + std::string(std::strerror(err));
+        return false;
+    }
+    
+    handle_ = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+    data_ = static_cast<byte*>(addr);
+    return true;
+}
+
 bool MMapFile::unmap_file() {
     bool success = true;
     
@@ -254,6 +389,7 @@ bool MMapFile::unmap_file() {
     }
     
     size_ = 0;
+    preallocated_ = false;
     return success;
 }
 
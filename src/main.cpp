@@ -17,6 +17,7 @@ Binary Diff/Patch Tool v1.0.0
   patch   应用补丁: patch <old_file> <patch_file> <new_file>
   verify  验证补丁: verify <old_file> <new_file> <patch_file>
   info    查看信息: info <patch_file>
+  index   预建索引: index <old_file> -o <index_file>
   batch   批量处理: batch diff <old_dir> <new_dir> <output_dir>
                     batch patch <old_dir> <patch_dir> <output_dir>
 
@@ -24,14 +25,35 @@ Binary Diff/Patch Tool v1.0.0
   -t, --threads <N>      线程数 (默认: 自动)
   -b, --block-size <MB>  块大小 MB (默认: 64)
   -c, --compress <0-12>  LZ4 压缩级别 (默认: 1)
+  -m, --mode <hash|sa>   匹配模式: hash 快速 / sa 后缀数组最大压缩 (默认: hash)
+  --cdc                 先按内容分块匹配整块，只对改动部分做细粒度匹配
+  --lazy <N>            惰性匹配: 向后检查 N 个位置，选择编码更短的匹配 (默认: 0 贪心)
+  --no-self-copy        不查找新文件块内的重复内容 (默认对旧文件中没有的重复内容输出 COPY_NEW)
+  --no-add              不输出近似匹配 (默认对 COPY 之后只有零星字节改动的区间输出 ADD 差值)
+  --level <1-9>         压缩等级预设: 1 最快 / 9 最小补丁，统一设置索引、匹配与 LZ4 参数
+                        (覆盖 -c、--lazy、--no-self-copy 与 --no-add)
+  --winnow <N>          索引改用 winnowing 采样，保证找到长度 >= N 字节的公共区域
+                        (N = 38/46 时索引规模与默认采样相当)
+  --index <file>        使用 index 命令预先构建的原文件索引，跳过索引构建
+                        (须与构建时的 --level / --winnow 一致)
+  --emit-index <file>   同时构建新文件的索引，供下一次以新文件为原文件的 diff 使用
   -e, --extension <ext>  文件扩展名 (batch: 默认 .pak)
   --no-verify           跳过校验
+  --no-sparse           patch: 零填充区域也实际写入 (默认留作稀疏文件的空洞)
+  --no-mmap             patch: 逐块写入输出文件 (默认直接重建到输出文件的映射中)
+  --direct              patch: 绕过页缓存写出输出文件 (O_DIRECT)，超大补丁时原文件保持在缓存中
+  --io <auto|uring|sync> 补丁读写的 I/O 后端 (默认: auto，支持时使用 io_uring)
+  --io-depth <N>        I/O 队列深度 (默认: 32)
   --progress            显示进度条
   -v, --verbose         详细输出
   -h, --help            显示帮助
 
 示例:
   bindiff diff old.pak new.pak patch.bdp --progress
+  bindiff diff old.pak new.pak patch.bdp --mode sa
+  bindiff diff old.pak new.pak patch.bdp --level 9
+  bindiff index old.pak -o old.bdi
+  bindiff diff old.pak new.pak patch.bdp --index old.bdi --emit-index new.bdi
   bindiff patch old.pak patch.bdp new.pak
   bindiff info patch.bdp
   bindiff batch diff old_paks/ new_paks/ patches/ -t 8
@@ -67,6 +89,49 @@ public:
     }
 };
 
+bool parse_match_mode(const std::string& value, bindiff::MatchMode& mode) {
+    if (value == "hash") {
+        mode = bindiff::MatchMode::Hash;
+    } else if (value == "sa") {
+        mode = bindiff::MatchMode::SuffixArray;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_io_backend(const std::string& value, bindiff::IoBackend& backend) {
+    if (value == "auto") {
+        backend = bindiff::IoBackend::Auto;
+    } else if (value == "uring") {
+        backend = bindiff::IoBackend::IoUring;
+    } else if (value == "sync") {
+        backend = bindiff::IoBackend::Sync;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 解析 --io / --io-depth 的参数 (diff 与 patch 共用)，返回 false 表示参数错误
+bool parse_io_option(const std::string& arg, int argc, char* argv[], int& i, bindiff::IoOptions& io) {
+    if (arg == "--io") {
+        if (i + 1 < argc && !parse_io_backend(argv[++i], io.backend)) {
+            std::cerr << "错误: 未知 I/O 后端: " << argv[i] << " (可选: auto, uring, sync)" << std::endl;
+            return false;
+        }
+    } else if (arg == "--io-depth") {
+        if (i + 1 < argc) {
+            io.queue_depth = static_cast<uint32_t>(std::stoul(argv[++i]));
+            if (io.queue_depth == 0) {
+                std::cerr << "错误: 队列深度须大于 0" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 int cmd_diff(int argc, char* argv[]) {
     bindiff::DiffOptions options;
     bool show_progress = false;
@@ -89,6 +154,45 @@ int cmd_diff(int argc, char* argv[]) {
             if (i + 1 < argc) {
                 options.compression_level = std::stoi(argv[++i]);
             }
+        } else if (arg == "-m" || arg == "--mode") {
+            if (i + 1 < argc && !parse_match_mode(argv[++i], options.match_mode)) {
+                std::cerr << "错误: 未知匹配模式: " << argv[i] << " (可选: hash, sa)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--cdc") {
+            options.chunk_matching = true;
+        } else if (arg == "--lazy") {
+            if (i + 1 < argc) {
+                options.lazy_lookahead = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+        } else if (arg == "--no-self-copy") {
+            options.self_copy = false;
+        } else if (arg == "--no-add") {
+            options.delta_add = false;
+        } else if (arg == "--winnow") {
+            if (i + 1 < argc) {
+                options.matcher.winnow_guarantee = std::stoul(argv[++i]);
+            }
+        } else if (arg == "--level") {
+            if (i + 1 < argc) {
+                options.effort = std::stoi(argv[++i]);
+                if (options.effort < bindiff::MIN_EFFORT || options.effort > bindiff::MAX_EFFORT) {
+                    std::cerr << "错误: 压缩等级须为 1-9: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--index") {
+            if (i + 1 < argc) {
+                options.index_path = argv[++i];
+            }
+        } else if (arg == "--emit-index") {
+            if (i + 1 < argc) {
+                options.emit_index_path = argv[++i];
+            }
+        } else if (arg == "--io" || arg == "--io-depth") {
+            if (!parse_io_option(arg, argc, argv, i, options.io)) {
+                return 1;
+            }
         } else if (arg == "--no-verify") {
             options.verify = false;
         } else if (arg == "--progress") {
@@ -132,6 +236,71 @@ int cmd_diff(int argc, char* argv[]) {
     return 0;
 }
 
+int cmd_index(int argc, char* argv[]) {
+    bindiff::DiffOptions options;
+    bool show_progress = false;
+    
+    std::string old_file, index_file;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "-o" || arg == "--output") {
+            if (i + 1 < argc) {
+                index_file = argv[++i];
+            }
+        } else if (arg == "-t" || arg == "--threads") {
+            if (i + 1 < argc) {
+                options.num_threads = std::stoi(argv[++i]);
+            }
+        } else if (arg == "--winnow") {
+            if (i + 1 < argc) {
+                options.matcher.winnow_guarantee = std::stoul(argv[++i]);
+            }
+        } else if (arg == "--level") {
+            if (i + 1 < argc) {
+                options.effort = std::stoi(argv[++i]);
+                if (options.effort < bindiff::MIN_EFFORT || options.effort > bindiff::MAX_EFFORT) {
+                    std::cerr << "错误: 压缩等级须为 1-9: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--progress") {
+            show_progress = true;
+        } else if (arg[0] != '-') {
+            if (old_file.empty()) old_file = arg;
+            else if (index_file.empty()) index_file = arg;
+        }
+    }
+    
+    if (old_file.empty() || index_file.empty()) {
+        std::cerr << "错误: 需要指定 old_file 和 -o index_file" << std::endl;
+        return 1;
+    }
+    
+    std::cout << "构建索引:" << std::endl;
+    std::cout << "  原文件: " << old_file << std::endl;
+    std::cout << "  索引:   " << index_file << std::endl;
+    
+    ConsoleProgress progress;
+    bindiff::ProgressCallback* callback = show_progress ? &progress : nullptr;
+    
+    auto result = bindiff::create_index(old_file, index_file, options, callback);
+    
+    if (!result.success) {
+        std::cerr << "错误: " << result.error << std::endl;
+        return 1;
+    }
+    
+    if (!show_progress) {
+        std::cout << "✓ 成功" << std::endl;
+        std::cout << "  用时: " << bindiff::format_duration(result.elapsed_seconds) << std::endl;
+    }
+    std::cout << "  索引大小: " << bindiff::format_size(bindiff::get_file_size(index_file)) << std::endl;
+    
+    return 0;
+}
+
 int cmd_patch(int argc, char* argv[]) {
     bindiff::PatchOptions options;
     bool show_progress = false;
@@ -143,6 +312,20 @@ int cmd_patch(int argc, char* argv[]) {
         
         if (arg == "--no-verify") {
             options.verify = false;
+        } else if (arg == "-t" || arg == "--threads") {
+            if (i + 1 < argc) {
+                options.num_threads = std::stoi(argv[++i]);
+            }
+        } else if (arg == "--no-sparse") {
+            options.sparse_output = false;
+        } else if (arg == "--no-mmap") {
+            options.mmap_output = false;
+        } else if (arg == "--direct") {
+            options.direct_output = true;
+        } else if (arg == "--io" || arg == "--io-depth") {
+            if (!parse_io_option(arg, argc, argv, i, options.io)) {
+                return 1;
+            }
         } else if (arg == "--progress") {
             show_progress = true;
         } else if (arg[0] != '-') {
@@ -326,11 +509,38 @@ int cmd_batch_diff(int argc, char* argv[]) {
             if (i + 1 < argc) {
                 diff_options.compression_level = std::stoi(argv[++i]);
             }
+        } else if (arg == "-m" || arg == "--mode") {
+            if (i + 1 < argc && !parse_match_mode(argv[++i], diff_options.match_mode)) {
+                std::cerr << "错误: 未知匹配模式: " << argv[i] << " (可选: hash, sa)" << std::endl;
+                return 1;
+            }
         } else if (arg == "-e" || arg == "--extension") {
             if (i + 1 < argc) {
                 extension = argv[++i];
                 if (extension[0] != '.') extension = "." + extension;
             }
+        } else if (arg == "--cdc") {
+            diff_options.chunk_matching = true;
+        } else if (arg == "--lazy") {
+            if (i + 1 < argc) {
+                diff_options.lazy_lookahead = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+        } else if (arg == "--no-self-copy") {
+            diff_options.self_copy = false;
+        } else if (arg == "--no-add") {
+            diff_options.delta_add = false;
+        } else if (arg == "--winnow") {
+            if (i + 1 < argc) {
+                diff_options.matcher.winnow_guarantee = std::stoul(argv[++i]);
+            }
+        } else if (arg == "--level") {
+            if (i + 1 < argc) {
+                diff_options.effort = std::stoi(argv[++i]);
+                if (diff_options.effort < bindiff::MIN_EFFORT || diff_options.effort > bindiff::MAX_EFFORT) {
+                    std::cerr << "错误: 压缩等级须为 1-9: " << argv[i] << std::endl;
+                    return 1;
+                }
+            }
         } else if (arg == "--no-verify") {
             diff_options.verify = false;
         } else if (arg[0] != '-') {
@@ -494,6 +704,10 @@ int main(int argc, char* argv[]) {
         return cmd_batch(argc, argv);
     }
     
+    if (command == "index") {
+        return cmd_index(argc, argv);
+    }
+    
     std::cerr << "未知命令: " << command << std::endl;
     std::cerr << "使用 --help 查看帮助" << std::endl;
     return 1;
@@ -0,0 +1,92 @@
+// 补丁应用 (块重建) 基准测试
+// 用法: bench_apply [重复次数]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "core/block_processor.hpp"
+#include "core/matcher.hpp"
+
+using namespace bindiff;
+
+namespace {
+
+constexpr size_t OLD_SIZE = 64 * MB;
+constexpr size_t BLOCK_SIZE = 32 * MB;
+
+struct Case {
+    const char* name;
+    size_t copy_len;     // 每段从旧文件复制的长度 (0 表示全部为新数据)
+    size_t insert_len;   // 每段新数据的长度
+};
+
+// 交替拼接旧文件片段与随机新数据
+std::vector<byte> make_new_data(const std::vector<byte>& old_data, const Case& c, std::mt19937_64& rng) {
+    std::vector<byte> data;
+    data.reserve(BLOCK_SIZE);
+    while (data.size() < BLOCK_SIZE) {
+        if (c.copy_len > 0) {
+            size_t offset = rng() % (old_data.size() - c.copy_len);
+            data.insert(data.end(), old_data.begin() + offset, old_data.begin() + offset + c.copy_len);
+        }
+        for (size_t i = 0; i < c.insert_len; ++i) {
+            data.push_back(static_cast<byte>(rng()));
+        }
+    }
+    data.resize(BLOCK_SIZE);
+    return data;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 10;
+
+    const Case cases[] = {
+        {"insert only", 0, 4096},
+        {"copy 64 / insert 64", 64, 64},
+        {"copy 256 / insert 32", 256, 32},
+        {"copy 4K / insert 512", 4096, 512},
+    };
+
+    std::mt19937_64 rng(12345);
+    std::vector<byte> old_data(OLD_SIZE);
+    for (auto& v : old_data) v = static_cast<byte>(rng());
+
+    BlockMatcher matcher;
+    matcher.build_index(old_data.data(), old_data.size());
+    BlockProcessor processor(BLOCK_SIZE);
+    std::vector<byte> output(BLOCK_SIZE);
+
+    printf("%-22s%12s%12s%14s\n", "case", "patch KB", "ops KB", "apply MB/s");
+    for (const auto& c : cases) {
+        auto new_data = make_new_data(old_data, c, rng);
+        auto result = processor.process_block(0, old_data.data(), old_data.size(),
+                                              new_data.data(), new_data.size(), &matcher);
+        if (!result.success) {
+            printf("%-22s编码失败\n", c.name);
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            if (!processor.reconstruct_block(0, old_data.data(), old_data.size(), result.data,
+                                             result.original_size, output.data(), output.size())) {
+                printf("%-22s重建失败\n", c.name);
+                return 1;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (output != new_data) {
+            printf("%-22s重建结果不一致\n", c.name);
+            return 1;
+        }
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        printf("%-22s%12zu%12u%14.0f\n", c.name, result.data.size() / 1024, result.original_size / 1024,
+               static_cast<double>(BLOCK_SIZE) * iterations / seconds / MB);
+    }
+    return 0;
+}
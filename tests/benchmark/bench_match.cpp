@@ -0,0 +1,96 @@
+// 匹配长度内核基准测试
+// 用法: bench_match [总字节数MB]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "core/match_length.hpp"
+
+using namespace bindiff;
+
+namespace {
+
+struct Case {
+    const char* name;
+    size_t match_len;   // 两段数据的公共前缀长度
+};
+
+// 对给定内核测量吞吐量 (按比较的字节数计)
+double run_case(MatchLengthFn fn, const std::vector<byte>& a, const std::vector<byte>& b,
+                size_t match_len, size_t total_bytes, size_t& checksum) {
+    // 每次比较 match_len + 1 字节 (最后一个字节不同)
+    size_t span = match_len + 1;
+    size_t stride = span + 64;
+    size_t slots = (a.size() - 64) / stride;
+    size_t iterations = std::max<size_t>(1, total_bytes / span);
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t sum = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        size_t off = (i % slots) * stride;
+        sum += fn(a.data() + off, b.data() + off, span + 63);
+    }
+    auto end = std::chrono::steady_clock::now();
+    
+    checksum += sum;
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(iterations) * span / seconds;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t total_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+    size_t total_bytes = total_mb << 20;
+    
+    const Case cases[] = {
+        {"short (31B)", 31},
+        {"medium (200B)", 200},
+        {"long (4KB)", 4096},
+        {"very long (1MB)", 1 << 20},
+    };
+    
+    const MatchKernel kernels[] = {
+        MatchKernel::Scalar, MatchKernel::SSE2, MatchKernel::AVX2, MatchKernel::AVX512,
+    };
+    
+    printf("当前内核: %s\n", match_kernel_name(active_match_kernel()));
+    printf("%-18s", "case");
+    for (auto kernel : kernels) {
+        printf("%12s", match_kernel_name(kernel));
+    }
+    printf("   (MB/s)\n");
+    
+    std::mt19937_64 rng(12345);
+    size_t checksum = 0;
+    
+    for (const auto& c : cases) {
+        // a 与 b 的每个槽位都有 match_len 字节公共前缀，随后的字节不同
+        size_t stride = c.match_len + 1 + 64;
+        size_t slots = std::max<size_t>(16, (8u << 20) / stride);
+        std::vector<byte> a(slots * stride + 64);
+        for (auto& v : a) v = static_cast<byte>(rng());
+        std::vector<byte> b = a;
+        for (size_t s = 0; s < slots; ++s) {
+            b[s * stride + c.match_len] ^= 0x5A;
+        }
+        
+        printf("%-18s", c.name);
+        for (auto kernel : kernels) {
+            MatchLengthFn fn = match_kernel(kernel);
+            if (!fn) {
+                printf("%12s", "n/a");
+                continue;
+            }
+            double rate = run_case(fn, a, b, c.match_len, total_bytes, checksum);
+            printf("%12.0f", rate / (1 << 20));
+        }
+        printf("\n");
+    }
+    
+    // 防止编译器优化掉比较
+    printf("(checksum %zu)\n", checksum);
+    return 0;
+}
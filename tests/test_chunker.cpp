@@ -0,0 +1,91 @@
+#include <iostream>
+#include <cstring>
+#include <vector>
+
+#include "core/chunker.hpp"
+
+namespace {
+
+std::vector<uint8_t> random_bytes(size_t size, uint32_t seed) {
+    std::vector<uint8_t> data(size);
+    for (auto& b : data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(chunker_shift_resilient) {
+    auto data = random_bytes(1024 * 1024, 99);
+    bindiff::ChunkerParams params;
+    
+    auto chunks = bindiff::chunk_data(data.data(), data.size(), params);
+    ASSERT(chunks.size() > 16);
+    
+    // 块首尾相接覆盖全部数据，长度在限制范围内
+    uint64_t offset = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        ASSERT(chunks[i].offset == offset);
+        ASSERT(chunks[i].length <= params.max_size);
+        ASSERT(chunks[i].length >= params.min_size || i + 1 == chunks.size());
+        offset += chunks[i].length;
+    }
+    ASSERT(offset == data.size());
+    
+    // 前面插入数据后，除开头几块外其余块应保持不变
+    auto shifted = random_bytes(777, 5);
+    shifted.insert(shifted.end(), data.begin(), data.end());
+    auto shifted_chunks = bindiff::chunk_data(shifted.data(), shifted.size(), params);
+    
+    size_t same = 0;
+    for (const auto& chunk : shifted_chunks) {
+        for (const auto& original : chunks) {
+            if (original.fingerprint == chunk.fingerprint && original.length == chunk.length) {
+                ++same;
+                break;
+            }
+        }
+    }
+    ASSERT(same + 2 >= chunks.size());
+    
+    return true;
+}
+
+TEST(chunker_match_anchors) {
+    auto old_data = random_bytes(512 * 1024, 1234);
+    
+    // 新数据: 旧数据后半段 + 随机数据 + 旧数据前半段
+    std::vector<uint8_t> new_data(old_data.begin() + 256 * 1024, old_data.end());
+    auto noise = random_bytes(10000, 77);
+    new_data.insert(new_data.end(), noise.begin(), noise.end());
+    new_data.insert(new_data.end(), old_data.begin(), old_data.begin() + 256 * 1024);
+    
+    auto anchors = bindiff::match_chunks(old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    ASSERT(!anchors.empty());
+    
+    // 锚点按新偏移排序、互不重叠，内容与旧文件完全一致，且覆盖大部分数据
+    uint64_t covered = 0;
+    uint64_t prev_end = 0;
+    for (const auto& anchor : anchors) {
+        ASSERT(anchor.new_offset >= prev_end);
+        ASSERT(std::memcmp(old_data.data() + anchor.old_offset,
+                           new_data.data() + anchor.new_offset, anchor.length) == 0);
+        prev_end = anchor.new_offset + anchor.length;
+        covered += anchor.length;
+    }
+    ASSERT(covered > old_data.size() * 3 / 4);
+    
+    // 按块范围裁剪后偏移相对块起点
+    uint64_t begin = 100000, end = 400000;
+    auto clipped = bindiff::anchors_in_range(anchors, begin, end);
+    ASSERT(!clipped.empty());
+    for (const auto& anchor : clipped) {
+        ASSERT(anchor.new_offset + anchor.length <= end - begin);
+        ASSERT(std::memcmp(old_data.data() + anchor.old_offset,
+                           new_data.data() + begin + anchor.new_offset, anchor.length) == 0);
+    }
+    
+    return true;
+}
@@ -1,8 +1,18 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <vector>
 
+#include "core/diff_engine.hpp"
+#include "core/index_file.hpp"
 #include "core/matcher.hpp"
+#include "core/match_length.hpp"
+#include "core/suffix_matcher.hpp"
+#include "crypto/sha256.hpp"
 
 TEST(matcher_rolling_hash) {
     bindiff::RollingHash hash(32);
@@ -32,6 +42,24 @@ TEST(matcher_rolling_hash) {
     return true;
 }
 
+TEST(matcher_buzhash_roll) {
+    bindiff::BuzHash hash(32);
+    
+    std::vector<uint8_t> data(256);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    
+    // 任意位置滚动得到的哈希应等于直接计算该窗口的哈希
+    hash.init(data.data(), 32);
+    for (size_t i = 1; i + 32 <= data.size(); ++i) {
+        hash.roll(data[i - 1], data[i + 31]);
+        ASSERT(hash.hash() == bindiff::BuzHash::compute(data.data() + i, 32));
+    }
+    
+    return true;
+}
+
 TEST(matcher_find_match) {
     bindiff::BlockMatcher matcher(8);  // 最小匹配 8 字节
     
@@ -101,6 +129,600 @@ TEST(matcher_partial_match) {
     return true;
 }
 
+TEST(matcher_index_covers_tail) {
+    bindiff::BlockMatcher matcher(32);
+    
+    // 伪随机旧数据，保证各位置哈希互不相同
+    std::vector<uint8_t> old_data(4 * 1024 * 1024);
+    uint32_t state = 12345;
+    for (auto& b : old_data) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<uint8_t>(state >> 16);
+    }
+    matcher.build_index_parallel(old_data.data(), old_data.size(), 32, 4);
+    ASSERT(matcher.index_entries() == old_data.size() - 32 + 1);
+    
+    // 文件尾部的偏移不应因桶容量被丢弃
+    size_t offset = old_data.size() - 100;
+    std::vector<uint8_t> new_data(old_data.begin() + offset, old_data.end());
+    
+    auto match = matcher.find_longest_match(
+        old_data.data(), old_data.size(),
+        new_data.data(), new_data.size(),
+        0
+    );
+    
+    ASSERT(match.valid());
+    ASSERT(match.old_offset == offset);
+    ASSERT(match.length == 100);
+    
+    return true;
+}
+
+TEST(matcher_cursor_rolling) {
+    bindiff::BlockMatcher matcher(32);
+    
+    std::vector<uint8_t> old_data(64 * 1024);
+    uint32_t state = 777;
+    for (auto& b : old_data) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<uint8_t>(state >> 16);
+    }
+    matcher.build_index(old_data.data(), old_data.size(), 32);
+    
+    // 新数据: 一段随机插入 + 旧数据片段
+    std::vector<uint8_t> new_data(300, 0x5A);
+    new_data.insert(new_data.end(), old_data.begin() + 1000, old_data.begin() + 3000);
+    
+    // 游标逐字节滚动的结果应与一次性查询一致
+    bindiff::MatchCursor cursor(matcher, old_data.data(), old_data.size(),
+                                new_data.data(), new_data.size());
+    for (size_t pos = 0; cursor.has_window(); cursor.advance(), ++pos) {
+        auto rolled = cursor.find();
+        auto direct = matcher.find_longest_match(
+            old_data.data(), old_data.size(),
+            new_data.data(), new_data.size(),
+            pos
+        );
+        ASSERT(rolled.length == direct.length);
+        ASSERT(rolled.old_offset == direct.old_offset);
+    }
+    
+    cursor.seek(300);
+    auto match = cursor.find();
+    ASSERT(match.old_offset == 1000);
+    ASSERT(match.length == 2000);
+    
+    return true;
+}
+
+TEST(matcher_cursor_skip_after_misses) {
+    // 条目上限迫使采样步长为 4
+    bindiff::MatcherParams params;
+    params.max_index_entries = 16384;
+    bindiff::BlockMatcher matcher(params);
+    
+    std::vector<uint8_t> old_data(64 * 1024);
+    uint32_t state = 777;
+    for (auto& b : old_data) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<uint8_t>(state >> 16);
+    }
+    matcher.build_index(old_data.data(), old_data.size(), 32);
+    ASSERT(matcher.index_step() == 4);
+    
+    // 长段随机插入之后查询间隔已增大，紧随其后的 64 字节旧数据在各个相位上都应被找到
+    for (size_t phase = 0; phase < 8; ++phase) {
+        std::vector<uint8_t> new_data(20000 + phase);
+        for (auto& b : new_data) {
+            state = state * 1103515245 + 12345;
+            b = static_cast<uint8_t>(state >> 16);
+        }
+        size_t start = new_data.size();
+        new_data.insert(new_data.end(), old_data.begin() + 5000 + phase, old_data.begin() + 5064 + phase);
+        new_data.insert(new_data.end(), 100, 0x5A);
+        
+        bindiff::MatchCursor cursor(matcher, old_data.data(), old_data.size(),
+                                    new_data.data(), new_data.size());
+        auto match = cursor.scan();
+        ASSERT(match.valid());
+        ASSERT(cursor.position() >= start && cursor.position() < start + 64);
+        ASSERT(match.old_offset - (cursor.position() - start) == 5000 + phase);
+    }
+    
+    return true;
+}
+
+TEST(matcher_match_length_kernels) {
+    std::vector<uint8_t> a(1000);
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+    
+    const bindiff::MatchKernel kernels[] = {
+        bindiff::MatchKernel::Scalar, bindiff::MatchKernel::SSE2,
+        bindiff::MatchKernel::AVX2, bindiff::MatchKernel::AVX512,
+    };
+    
+    // 所有可用内核在各种不匹配位置和长度上限下结果一致
+    for (size_t diff_at = 0; diff_at < 300; diff_at += 7) {
+        std::vector<uint8_t> b = a;
+        b[diff_at] ^= 0xFF;
+        for (size_t max_len : {size_t(0), size_t(1), size_t(63), size_t(64), size_t(65), size_t(200), a.size()}) {
+            size_t expected = std::min(diff_at, max_len);
+            for (auto kernel : kernels) {
+                auto fn = bindiff::match_kernel(kernel);
+                if (!fn) continue;
+                ASSERT(fn(a.data(), b.data(), max_len) == expected);
+            }
+            ASSERT(bindiff::match_length(a.data(), b.data(), max_len) == expected);
+        }
+    }
+    
+    ASSERT(bindiff::match_kernel_supported(bindiff::MatchKernel::Scalar));
+    ASSERT(bindiff::match_length(a.data(), a.data(), a.size()) == a.size());
+    
+    return true;
+}
+
+TEST(matcher_match_length_backward) {
+    std::vector<uint8_t> a(100), b(100);
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = b[i] = static_cast<uint8_t>(i * 13 + 1);
+    }
+    b[60] ^= 0xFF;
+    
+    // 从末尾向前，直到第 60 字节处不同
+    ASSERT(bindiff::match_length_backward(a.data() + 100, b.data() + 100, 100) == 39);
+    ASSERT(bindiff::match_length_backward(a.data() + 100, b.data() + 100, 10) == 10);
+    ASSERT(bindiff::match_length_backward(a.data() + 60, b.data() + 60, 60) == 60);
+    ASSERT(bindiff::match_length_backward(a.data() + 61, b.data() + 61, 61) == 0);
+    
+    return true;
+}
+
+TEST(matcher_suffix_array_longest) {
+    // 低熵数据，包含大量重复子串
+    std::vector<uint8_t> old_data(20000);
+    uint32_t state = 4242;
+    for (auto& b : old_data) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<uint8_t>((state >> 16) % 3);
+    }
+    std::vector<uint8_t> new_data(old_data.begin() + 5000, old_data.begin() + 5600);
+    for (size_t i = 0; i < new_data.size(); i += 97) {
+        new_data[i] ^= 1;
+    }
+    
+    // 小段大小，覆盖多段查询及跨段扩展
+    bindiff::SuffixMatcher matcher(8);
+    matcher.build(old_data.data(), old_data.size(), 2, 3000);
+    ASSERT(matcher.num_segments() == 7);
+    
+    // 结果长度应与暴力搜索的最长匹配一致
+    for (size_t pos = 0; pos + 8 <= new_data.size(); pos += 13) {
+        size_t best = 0;
+        for (size_t i = 0; i < old_data.size(); ++i) {
+            size_t len = 0;
+            while (i + len < old_data.size() && pos + len < new_data.size() &&
+                   old_data[i + len] == new_data[pos + len]) {
+                ++len;
+            }
+            best = std::max(best, len);
+        }
+        
+        auto match = matcher.find_longest_match(
+            old_data.data(), old_data.size(), new_data.data(), new_data.size(), pos);
+        ASSERT(match.length == (best >= 8 ? best : 0));
+        if (match.valid()) {
+            ASSERT(std::memcmp(old_data.data() + match.old_offset,
+                               new_data.data() + pos, match.length) == 0);
+        }
+    }
+    
+    return true;
+}
+
+TEST(matcher_suffix_array_segment_boundary) {
+    // 低熵数据: 段内总有其他后缀与查找键有较长的公共前缀，跨段匹配被截断时会选错
+    std::vector<uint8_t> old_data(20000);
+    uint32_t state = 777;
+    for (auto& b : old_data) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<uint8_t>((state >> 16) % 3);
+    }
+    bindiff::SuffixMatcher matcher(8);
+    matcher.build(old_data.data(), old_data.size(), 1, 3000);
+    
+    // 匹配从段尾前 1..40 字节开始，延伸到下一段
+    for (size_t lead = 1; lead <= 40; ++lead) {
+        size_t offset = 6000 - lead;
+        std::vector<uint8_t> new_data(old_data.begin() + offset, old_data.begin() + offset + 300);
+        new_data.push_back(7);
+        auto match = matcher.find_longest_match(
+            old_data.data(), old_data.size(), new_data.data(), new_data.size(), 0);
+        ASSERT(match.length >= 300);
+        ASSERT(std::memcmp(old_data.data() + match.old_offset, new_data.data(), match.length) == 0);
+    }
+    
+    // 只在采样位置查找时，游标仍停在跨段匹配的起点
+    std::vector<uint8_t> new_data(64, 9);
+    new_data.insert(new_data.end(), old_data.begin() + 8995, old_data.begin() + 9200);
+    bindiff::SuffixCursor cursor(matcher, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    auto match = cursor.scan();
+    ASSERT(match.valid());
+    ASSERT(cursor.position() == 64);
+    ASSERT(match.length >= 205);
+    ASSERT(std::memcmp(old_data.data() + match.old_offset, new_data.data() + 64, match.length) == 0);
+    
+    return true;
+}
+
+TEST(matcher_index_skip_ranges) {
+    std::vector<uint8_t> old_data(64 * 1024);
+    uint32_t state = 31337;
+    for (auto& b : old_data) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<uint8_t>(state >> 16);
+    }
+    
+    bindiff::BlockMatcher full(32), partial(32);
+    full.build_index(old_data.data(), old_data.size(), 32);
+    
+    // 跳过 [8192, 40960) 与 [36864, 49152)，重叠区间应被合并
+    std::vector<bindiff::ByteRange> skip = {{36864, 12288}, {8192, 32768}};
+    partial.build_index_parallel(old_data.data(), old_data.size(), 32, 2, skip);
+    ASSERT(partial.index_entries() == full.index_entries() - (49152 - 8192 - 32 + 1));
+    
+    // 跳过区间内的内容查不到，区间外的仍可匹配
+    auto inside = partial.find_longest_match(old_data.data(), old_data.size(),
+                                             old_data.data() + 20000, 64, 0);
+    ASSERT(!inside.valid());
+    auto outside = partial.find_longest_match(old_data.data(), old_data.size(),
+                                              old_data.data() + 60000, 64, 0);
+    ASSERT(outside.valid());
+    ASSERT(outside.old_offset == 60000);
+    
+    return true;
+}
+
+TEST(matcher_effort_presets) {
+    // effort 0 保留单独设置
+    bindiff::DiffOptions custom;
+    custom.compression_level = 7;
+    custom.matcher.max_probes = 5;
+    auto kept = bindiff::resolve_effort(custom);
+    ASSERT(kept.compression_level == 7);
+    ASSERT(kept.matcher.max_probes == 5);
+    
+    // 5 级与默认值相同
+    bindiff::DiffOptions defaults;
+    bindiff::DiffOptions level5;
+    level5.effort = 5;
+    auto resolved = bindiff::resolve_effort(level5);
+    ASSERT(resolved.compression_level == defaults.compression_level);
+    ASSERT(resolved.lazy_lookahead == defaults.lazy_lookahead);
+    ASSERT(resolved.self_copy == defaults.self_copy);
+    ASSERT(resolved.delta_add == defaults.delta_add);
+    ASSERT(resolved.matcher.min_match == defaults.matcher.min_match);
+    ASSERT(resolved.matcher.max_probes == defaults.matcher.max_probes);
+    ASSERT(resolved.matcher.good_match == defaults.matcher.good_match);
+    ASSERT(resolved.matcher.sample_step_large == defaults.matcher.sample_step_large);
+    
+    // 最快等级不做近似匹配，调用方的 --no-add 在 5 级下同样被预设覆盖
+    bindiff::DiffOptions fastest;
+    fastest.effort = 1;
+    ASSERT(!bindiff::resolve_effort(fastest).delta_add);
+    level5.delta_add = false;
+    ASSERT(bindiff::resolve_effort(level5).delta_add);
+    
+    // 等级越高，采样越密、验证的候选越多
+    for (int effort = bindiff::MIN_EFFORT; effort < bindiff::MAX_EFFORT; ++effort) {
+        bindiff::DiffOptions lower, higher;
+        lower.effort = effort;
+        higher.effort = effort + 1;
+        auto a = bindiff::resolve_effort(lower).matcher;
+        auto b = bindiff::resolve_effort(higher).matcher;
+        ASSERT(b.sample_step_large <= a.sample_step_large);
+        ASSERT(b.max_probes >= a.max_probes);
+        ASSERT(b.max_index_entries >= a.max_index_entries);
+    }
+    
+    // 参数传入匹配器后，查询结果与默认参数一致
+    std::vector<uint8_t> data(4096);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>((i * 131) ^ (i >> 7));
+    }
+    bindiff::BlockMatcher matcher(resolved.matcher);
+    matcher.build_index(data.data(), data.size(), resolved.matcher.min_match);
+    auto match = matcher.find_longest_match(data.data(), data.size(), data.data() + 1000, 100, 0);
+    ASSERT(match.valid());
+    ASSERT(match.length == 100);
+    
+    return true;
+}
+
+TEST(matcher_winnow_guarantee) {
+    uint32_t seed = 99;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>(seed >> 16);
+    };
+    std::vector<uint8_t> old_data(256 * 1024);
+    for (auto& b : old_data) b = next();
+    // 一段重复字节: 选中位置在 w 内只保留一个
+    std::fill(old_data.begin() + 100000, old_data.begin() + 164000, 0);
+    
+    bindiff::MatcherParams params;
+    params.winnow_guarantee = 38;
+    bindiff::BlockMatcher matcher(params);
+    matcher.build_index(old_data.data(), old_data.size(), params.min_match);
+    ASSERT(matcher.index_winnow() == 7);
+    
+    // 随机内容上选中密度约 2 / (w + 1)，重复字节段约 1 / w
+    size_t random_positions = old_data.size() - 64000;
+    size_t expected = random_positions / 4 + 64000 / 7;
+    ASSERT(matcher.index_entries() > expected * 8 / 10);
+    ASSERT(matcher.index_entries() < expected * 12 / 10);
+    
+    // 任意对齐的 38 字节公共区域都能找到
+    std::vector<uint8_t> new_data(1038);
+    for (size_t trial = 0; trial < 300; ++trial) {
+        size_t offset = (trial * 7919) % 90000;
+        for (auto& b : new_data) b = next();
+        std::memcpy(new_data.data() + 500, old_data.data() + offset, 38);
+        
+        bindiff::MatchCursor cursor(matcher, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+        auto match = cursor.scan();
+        ASSERT(match.valid());
+        ASSERT(cursor.position() >= 500 && cursor.position() <= 506);
+        ASSERT(match.old_offset == offset + (cursor.position() - 500));
+    }
+    
+    // 重复字节段同样能找到
+    std::fill(new_data.begin() + 200, new_data.begin() + 800, 0);
+    bindiff::MatchCursor cursor(matcher, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    cursor.seek(200);
+    auto match = cursor.scan();
+    ASSERT(match.valid());
+    ASSERT(cursor.position() < 240);
+    
+    return true;
+}
+
+TEST(matcher_index_runs) {
+    uint32_t seed = 21;
+    std::vector<uint8_t> old_data(512 * 1024);
+    for (auto& b : old_data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    // 短的零填充在前、长的在后，另有一段周期为 4 的重复模式
+    std::fill(old_data.begin() + 10000, old_data.begin() + 11000, 0);
+    std::fill(old_data.begin() + 100000, old_data.begin() + 200000, 0);
+    for (size_t i = 300000; i < 340000; ++i) {
+        old_data[i] = "pad!"[i % 4];
+    }
+    
+    bindiff::BlockMatcher matcher;
+    matcher.build_index(old_data.data(), old_data.size(), 32);
+    // 重复区段内的窗口不再逐个进入索引
+    ASSERT(matcher.index_entries() < old_data.size() - 140000);
+    
+    // 零窗口所在的桶里只剩一个同标签候选
+    std::vector<uint8_t> zeros(32, 0);
+    uint64_t hash = bindiff::IndexHash::compute(zeros.data(), zeros.size());
+    const auto& index = matcher.index_arrays();
+    size_t bucket = hash & (index.num_buckets - 1);
+    size_t candidates = 0;
+    for (size_t e = index.bucket_starts[bucket]; e < index.bucket_starts[bucket + 1]; ++e) {
+        candidates += index.tags[e] == static_cast<uint8_t>(hash >> 40);
+    }
+    ASSERT(candidates == 1);
+    
+    // 查询落在最长的同模式区段上，任意相位都能找到
+    std::vector<uint8_t> new_data(60000, 0);
+    auto match = matcher.find_longest_match(old_data.data(), old_data.size(), new_data.data(), new_data.size(), 0);
+    ASSERT(match.length == new_data.size());
+    ASSERT(match.old_offset >= 100000 && match.old_offset < 200000);
+    
+    for (size_t phase = 0; phase < 4; ++phase) {
+        for (size_t i = 0; i < 20000; ++i) {
+            new_data[i] = "pad!"[(i + phase) % 4];
+        }
+        match = matcher.find_longest_match(old_data.data(), old_data.size(), new_data.data(), 20000, 0);
+        ASSERT(match.length == 20000);
+        ASSERT(std::memcmp(old_data.data() + match.old_offset, new_data.data(), 20000) == 0);
+    }
+    
+    return true;
+}
+
+TEST(matcher_index_file_roundtrip) {
+    uint32_t seed = 7;
+    std::vector<uint8_t> old_data(512 * 1024);
+    for (auto& b : old_data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    std::array<uint8_t, 32> sha{};
+    sha[0] = 1;
+    const char* old_path = "test_matcher_index.bin";
+    const char* path = "test_matcher_index.bdi";
+    std::ofstream(old_path, std::ios::binary)
+        .write(reinterpret_cast<const char*>(old_data.data()), old_data.size());
+    
+    bindiff::BlockMatcher built;
+    built.build_index(old_data.data(), old_data.size(), 32);
+    std::string error;
+    ASSERT(bindiff::save_index_file(path, built, old_path, old_data.size(), &sha, error));
+    
+    // 加载后的索引与现场构建的查询结果一致
+    {
+        bindiff::BlockMatcher loaded;
+        ASSERT(bindiff::load_index_file(path, loaded, old_path, old_data.size(), &sha, error));
+        ASSERT(loaded.index_entries() == built.index_entries());
+        ASSERT(loaded.index_step() == built.index_step());
+        for (size_t offset = 1000; offset < old_data.size() - 4096; offset += 37 * 1024) {
+            auto a = built.find_longest_match(old_data.data(), old_data.size(), old_data.data() + offset, 4096, 0);
+            auto b = loaded.find_longest_match(old_data.data(), old_data.size(), old_data.data() + offset, 4096, 0);
+            ASSERT(b.valid());
+            ASSERT(a.old_offset == b.old_offset && a.length == b.length);
+        }
+    }
+    
+    // 不带 SHA256 时比较修改时间: 原文件未动时通过，改动后拒绝
+    bindiff::BlockMatcher rejected;
+    ASSERT(bindiff::load_index_file(path, rejected, old_path, old_data.size(), nullptr, error));
+    auto mtime = std::filesystem::last_write_time(old_path);
+    std::filesystem::last_write_time(old_path, mtime + std::chrono::seconds(1));
+    ASSERT(!bindiff::load_index_file(path, rejected, old_path, old_data.size(), nullptr, error));
+    ASSERT(error.find("修改时间") != std::string::npos);
+    
+    // 带 SHA256 时以 SHA256 为准 (如随旧文件一起拷贝后修改时间已变)
+    ASSERT(bindiff::load_index_file(path, rejected, old_path, old_data.size(), &sha, error));
+    std::array<uint8_t, 32> other_sha{};
+    ASSERT(!bindiff::load_index_file(path, rejected, old_path, old_data.size(), &other_sha, error));
+    ASSERT(!bindiff::load_index_file(path, rejected, old_path, old_data.size() + 1, &sha, error));
+    
+    // 采样方式与调用方参数不符时拒绝
+    bindiff::MatcherParams winnow_params;
+    winnow_params.winnow_guarantee = 40;
+    bindiff::BlockMatcher winnowing(winnow_params);
+    ASSERT(!bindiff::load_index_file(path, winnowing, old_path, old_data.size(), &sha, error));
+    ASSERT(error.find("采样方式") != std::string::npos);
+    bindiff::MatcherParams sparse_params;
+    sparse_params.max_index_entries = 65536;
+    bindiff::BlockMatcher sparse(sparse_params);
+    ASSERT(!bindiff::load_index_file(path, sparse, old_path, old_data.size(), &sha, error));
+    ASSERT(!winnowing.has_index() && !sparse.has_index());
+    
+    // 桶表被改坏时拒绝，查询不会读出数组之外
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(4099);
+        char value = 0x7F;
+        file.write(&value, 1);
+    }
+    ASSERT(!bindiff::load_index_file(path, rejected, old_path, old_data.size(), &sha, error));
+    ASSERT(error.find("桶表") != std::string::npos);
+    
+    // 原文件短于 min_match 时保存只有一个空桶的索引，加载后没有条目
+    {
+        std::vector<uint8_t> short_data(old_data.begin(), old_data.begin() + 10);
+        std::ofstream(old_path, std::ios::binary)
+            .write(reinterpret_cast<const char*>(short_data.data()), short_data.size());
+        bindiff::BlockMatcher short_built;
+        short_built.build_index(short_data.data(), short_data.size(), 32);
+        ASSERT(bindiff::save_index_file(path, short_built, old_path, short_data.size(), &sha, error));
+        bindiff::BlockMatcher loaded;
+        ASSERT(bindiff::load_index_file(path, loaded, old_path, short_data.size(), &sha, error));
+        ASSERT(loaded.index_entries() == 0);
+        ASSERT(!loaded.find_longest_match(short_data.data(), short_data.size(), short_data.data(), short_data.size(), 0).valid());
+    }
+    
+    std::remove(path);
+    std::remove(old_path);
+    return true;
+}
+
+TEST(matcher_emit_index_chain) {
+    uint32_t seed = 11;
+    std::vector<uint8_t> old_data(300 * 1024);
+    for (auto& b : old_data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    std::vector<uint8_t> new_data = old_data;
+    std::memset(new_data.data() + 100000, 0x5A, 5000);
+    {
+        std::ofstream("test_chain_old.bin", std::ios::binary)
+            .write(reinterpret_cast<const char*>(old_data.data()), old_data.size());
+        std::ofstream("test_chain_new.bin", std::ios::binary)
+            .write(reinterpret_cast<const char*>(new_data.data()), new_data.size());
+    }
+    
+    bindiff::DiffOptions options;
+    options.num_threads = 2;
+    options.emit_index_path = "test_chain_new.bdi";
+    auto result = bindiff::create_diff("test_chain_old.bin", "test_chain_new.bin", "test_chain.bdp", options);
+    ASSERT(result.success);
+    
+    // diff 顺带写出的索引与单独构建的新文件索引相同，且记录了新文件的 SHA256
+    auto new_sha = bindiff::SHA256::compute(new_data.data(), new_data.size());
+    bindiff::BlockMatcher loaded;
+    std::string error;
+    ASSERT(bindiff::load_index_file("test_chain_new.bdi", loaded, "test_chain_new.bin", new_data.size(),
+                                    &new_sha, error));
+    bindiff::BlockMatcher built;
+    built.build_index(new_data.data(), new_data.size(), 32);
+    ASSERT(loaded.index_entries() == built.index_entries());
+    
+    std::array<uint8_t, 32> other_sha{};
+    ASSERT(!bindiff::load_index_file("test_chain_new.bdi", loaded, "test_chain_new.bin", new_data.size(),
+                                     &other_sha, error));
+    
+    // 新文件短于一个窗口 (含空文件) 时仍写出可加载的空索引
+    for (size_t short_size : {size_t(0), size_t(10)}) {
+        std::vector<uint8_t> short_data(old_data.begin(), old_data.begin() + short_size);
+        std::ofstream("test_chain_new.bin", std::ios::binary)
+            .write(reinterpret_cast<const char*>(short_data.data()), short_data.size());
+        std::remove("test_chain_new.bdi");
+
+        result = bindiff::create_diff("test_chain_old.bin", "test_chain_new.bin", "test_chain.bdp", options);
+        ASSERT(result.success);
+        auto short_sha = bindiff::SHA256::compute(short_data.data(), short_data.size());
+        bindiff::BlockMatcher empty;
+        ASSERT(bindiff::load_index_file("test_chain_new.bdi", empty, "test_chain_new.bin", short_data.size(),
+                                        &short_sha, error));
+        ASSERT(empty.has_index());
+        ASSERT(empty.index_entries() == 0);
+    }
+
+    std::remove("test_chain_old.bin");
+    std::remove("test_chain_new.bin");
+    std::remove("test_chain.bdp");
+    std::remove("test_chain_new.bdi");
+    return true;
+}
+
+TEST(matcher_index_builder_segments) {
+    uint32_t seed = 23;
+    std::vector<uint8_t> data(512 * 1024);
+    for (auto& b : data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    // 重复区段与跳过区间跨越分段边界
+    std::fill(data.begin() + 40000, data.begin() + 50000, 0x11);
+    std::vector<bindiff::ByteRange> skip = {{200000, 30000}};
+    
+    for (size_t guarantee : {size_t(0), size_t(48)}) {
+        bindiff::MatcherParams params;
+        params.winnow_guarantee = guarantee;
+        bindiff::BlockMatcher whole(params), segmented(params);
+        whole.build_index_parallel(data.data(), data.size(), 32, 1, skip);
+        
+        // 分段收集 (段长不与采样步长对齐，倒序收集) 与一次构建的索引完全相同
+        bindiff::IndexBuilder builder(segmented, data.data(), data.size(), 32, 10007, 2, skip);
+        for (size_t k = builder.segments(); k-- > 0;) {
+            builder.collect(k);
+        }
+        builder.finish();
+        
+        const auto& a = whole.index_arrays();
+        const auto& b = segmented.index_arrays();
+        ASSERT(a.num_entries > 0);
+        ASSERT(a.num_entries == b.num_entries);
+        ASSERT(a.num_buckets == b.num_buckets);
+        ASSERT(std::equal(a.bucket_starts, a.bucket_starts + a.num_buckets + 1, b.bucket_starts));
+        ASSERT(std::equal(a.offsets_lo, a.offsets_lo + a.num_entries, b.offsets_lo));
+        ASSERT(std::equal(a.tags, a.tags + a.num_entries, b.tags));
+        ASSERT(whole.index_winnow() == segmented.index_winnow());
+    }
+    return true;
+}
+
 void register_matcher_tests() {
     // 已通过 TEST 宏自动注册
 }
@@ -1,9 +1,11 @@
 #include <iostream>
 #include <cstring>
+#include <new>
 #include <vector>
 
 // 手动包含需要的头文件
 #include "io/mmap_file.hpp"
+#include "io/async_file.hpp"
 #include "io/file_utils.hpp"
 
 // 测试注册函数
@@ -97,6 +99,146 @@ TEST(mmap_large_file) {
     return true;
 }
 
+TEST(mmap_create_write) {
+    std::string path = "/tmp/bindiff_test_create.bin";
+    const size_t size = 256 * 1024;
+    
+    bindiff::MMapFile file;
+    ASSERT(file.create(path, size));
+    ASSERT(file.size() == size);
+    
+    // 新建的映射读出为零，写入映射即写入文件
+    ASSERT(file.data()[0] == 0 && file.data()[size - 1] == 0);
+    for (size_t i = 0; i < size; ++i) {
+        file.data()[i] = static_cast<uint8_t>(i * 13);
+    }
+    ASSERT(file.flush());
+    
+    // 释放中间 64KB (文件系统支持时读出为零)
+    bool punched = file.punch_hole(64 * 1024, 64 * 1024);
+    file.close();
+    
+    bindiff::MMapFile reopened;
+    ASSERT(reopened.open(path));
+    ASSERT(reopened.size() == size);
+    for (size_t i = 0; i < size; ++i) {
+        bool in_hole = punched && i >= 64 * 1024 && i < 128 * 1024;
+        ASSERT(reopened.data()[i] == (in_hole ? 0 : static_cast<uint8_t>(i * 13)));
+    }
+    reopened.close();
+    
+    // 无法创建时报告错误
+    bindiff::MMapFile bad;
+    ASSERT(!bad.create("/tmp/nonexistent_dir_xyz/out.bin", 16));
+    ASSERT(!bad.error().empty());
+    
+    bindiff::delete_file(path);
+    return true;
+}
+
+TEST(async_file_read_write) {
+    std::string path = "/tmp/bindiff_test_async.bin";
+    std::vector<uint8_t> data(1024 * 1024 + 123);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    
+    // 两种后端: 分段乱序写入、乱序读回，队列深度小于请求数
+    for (auto backend : {bindiff::IoBackend::Sync, bindiff::IoBackend::Auto}) {
+        bindiff::IoOptions options;
+        options.backend = backend;
+        options.queue_depth = 4;
+        const size_t piece = 64 * 1024;
+        size_t pieces = (data.size() + piece - 1) / piece;
+        
+        std::string error;
+        auto writer = bindiff::AsyncFile::open(path, bindiff::AsyncFile::Mode::Write, options, error);
+        ASSERT(writer);
+        ASSERT(writer->resize(data.size()));
+        for (size_t k = pieces; k > 0; --k) {
+            size_t offset = (k - 1) * piece;
+            ASSERT(writer->submit_write(data.data() + offset, std::min(piece, data.size() - offset), offset, k - 1));
+        }
+        // 排队的请求可以先提交再等待，也可以直接等待
+        ASSERT(writer->submit());
+        ASSERT(writer->wait_all());
+        writer.reset();
+        
+        auto reader = bindiff::AsyncFile::open(path, bindiff::AsyncFile::Mode::Read, options, error);
+        ASSERT(reader);
+        ASSERT(reader->size() == data.size());
+        std::vector<uint8_t> copy(data.size());
+        std::vector<bool> seen(pieces, false);
+        for (size_t k = 0; k < pieces; ++k) {
+            size_t offset = k * piece;
+            ASSERT(reader->submit_read(copy.data() + offset, std::min(piece, data.size() - offset), offset, k));
+        }
+        uint64_t tag;
+        while (reader->pending() > 0) {
+            ASSERT(reader->wait_one(tag));
+            ASSERT(tag < pieces && !seen[tag]);
+            seen[tag] = true;
+        }
+        ASSERT(copy == data);
+        
+        // 读取越过文件末尾时报错
+        ASSERT(reader->submit_read(copy.data(), 16, data.size() - 8) || !reader->error().empty());
+        ASSERT(!reader->wait_all());
+        ASSERT(!reader->error().empty());
+    }
+    
+    std::string error;
+    ASSERT(!bindiff::AsyncFile::open("/tmp/nonexistent_dir_xyz/a.bin", bindiff::AsyncFile::Mode::Write, {}, error));
+    ASSERT(!error.empty());
+    
+    bindiff::delete_file(path);
+    return true;
+}
+
+TEST(async_file_direct_write) {
+    // 直接 I/O: 对齐的缓冲区与偏移，末尾补齐后截断；文件系统不支持时按普通写入，结果相同
+    std::string path = "/tmp/bindiff_test_direct.bin";
+    const size_t align = bindiff::AsyncFile::DIRECT_ALIGN;
+    const size_t size = 3 * align + 100;
+    uint8_t* buffer = static_cast<uint8_t*>(::operator new[](4 * align, std::align_val_t(align)));
+    for (size_t i = 0; i < 4 * align; ++i) {
+        buffer[i] = static_cast<uint8_t>(i * 13 + 1);
+    }
+    
+    for (auto backend : {bindiff::IoBackend::Sync, bindiff::IoBackend::Auto}) {
+        bindiff::IoOptions options;
+        options.backend = backend;
+        std::string error;
+        auto writer = bindiff::AsyncFile::open(path, bindiff::AsyncFile::Mode::WriteDirect, options, error);
+        ASSERT(writer);
+        ASSERT(writer->submit_write(buffer + 2 * align, 2 * align, 2 * align));
+        ASSERT(writer->submit_write(buffer, 2 * align, 0));
+        ASSERT(writer->wait_all());
+        ASSERT(writer->resize(size));
+        writer->drop_cache(0, size);
+        writer.reset();
+        
+        bindiff::MMapFile file;
+        ASSERT(file.open(path));
+        ASSERT(file.size() == size);
+        ASSERT(std::memcmp(file.data(), buffer, size) == 0);
+    }
+    
+    // 未对齐的写入被拒绝时退回普通写入
+    std::string error;
+    auto writer = bindiff::AsyncFile::open(path, bindiff::AsyncFile::Mode::WriteDirect, {}, error);
+    ASSERT(writer);
+    ASSERT(writer->submit_write(buffer + 1, 100, 7));
+    ASSERT(writer->wait_all());
+    ASSERT(!writer->direct());
+    ASSERT(writer->size() == 107);
+    writer.reset();
+    
+    ::operator delete[](buffer, std::align_val_t(align));
+    bindiff::delete_file(path);
+    return true;
+}
+
 TEST(file_utils) {
     std::string path = "/tmp/bindiff_test_utils.bin";
     std::vector<uint8_t> data = {1, 2, 3};
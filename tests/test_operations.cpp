@@ -3,6 +3,33 @@
 #include <vector>
 
 #include "core/operations.hpp"
+#include "core/block_processor.hpp"
+#include "core/diff_engine.hpp"
+#include "core/patch_engine.hpp"
+#include "io/file_utils.hpp"
+
+// 把操作打包为三个流都原样存储的 v3 块数据
+static std::vector<uint8_t> raw_block(const std::vector<bindiff::Operation>& ops) {
+    bindiff::OperationStreams streams;
+    bindiff::OperationSerializer::serialize_all(ops, streams);
+    std::vector<uint8_t> payload;
+    for (const auto* stream : {&streams.control, &streams.literals, &streams.diffs}) {
+        bindiff::StreamHeader header;
+        header.codec = static_cast<uint8_t>(bindiff::CompressionType::None);
+        header.raw_size = header.stored_size = static_cast<uint32_t>(stream->size());
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&header);
+        payload.insert(payload.end(), bytes, bytes + sizeof(header));
+    }
+    payload.insert(payload.end(), streams.control.begin(), streams.control.end());
+    payload.insert(payload.end(), streams.literals.begin(), streams.literals.end());
+    payload.insert(payload.end(), streams.diffs.begin(), streams.diffs.end());
+    return payload;
+}
+
+// 操作引用的数据 (INSERT 内容 / ADD 差值)
+static std::vector<uint8_t> op_data(const bindiff::Operation& op) {
+    return std::vector<uint8_t>(op.data, op.data + op.data_length);
+}
 
 TEST(operations_copy) {
     auto op = bindiff::Operation::copy(0x123456789ABCDEF0ULL, 0x12345678);
@@ -16,11 +43,11 @@ TEST(operations_copy) {
 
 TEST(operations_insert) {
     std::vector<uint8_t> data = {1, 2, 3, 4, 5};
-    auto op = bindiff::Operation::insert(data);
+    auto op = bindiff::Operation::insert(data.data(), data.size());
     
     ASSERT(op.opcode == bindiff::OpCode::INSERT);
-    ASSERT(op.insert_data.size() == 5);
-    ASSERT(std::memcmp(op.insert_data.data(), data.data(), 5) == 0);
+    ASSERT(op.data == data.data());   // 不复制
+    ASSERT(op.data_length == 5);
     
     return true;
 }
@@ -46,7 +73,7 @@ TEST(operations_serialize_copy) {
 
 TEST(operations_serialize_insert) {
     std::vector<uint8_t> data = {10, 20, 30};
-    auto op = bindiff::Operation::insert(data);
+    auto op = bindiff::Operation::insert(data.data(), data.size());
     
     std::vector<uint8_t> buffer;
     bindiff::OperationSerializer::serialize(op, buffer);
@@ -83,7 +110,7 @@ TEST(operations_deserialize_copy) {
 
 TEST(operations_deserialize_insert) {
     std::vector<uint8_t> data = {1, 2, 3, 4, 5};
-    auto orig = bindiff::Operation::insert(data);
+    auto orig = bindiff::Operation::insert(data.data(), data.size());
     
     std::vector<uint8_t> buffer;
     bindiff::OperationSerializer::serialize(orig, buffer);
@@ -97,16 +124,18 @@ TEST(operations_deserialize_insert) {
     // 修正: length=5, 所以总大小是 1+4+5=10
     ASSERT(read == 10);
     ASSERT(parsed.opcode == bindiff::OpCode::INSERT);
-    ASSERT(parsed.insert_data.size() == 5);
-    ASSERT(std::memcmp(parsed.insert_data.data(), data.data(), 5) == 0);
+    ASSERT(parsed.data_length == 5);
+    ASSERT(parsed.data == buffer.data() + 5);   // 指向输入缓冲区
+    ASSERT(std::memcmp(parsed.data, data.data(), 5) == 0);
     
     return true;
 }
 
 TEST(operations_serialize_all) {
+    const uint8_t literal[] = {1, 2, 3};
     std::vector<bindiff::Operation> ops;
     ops.push_back(bindiff::Operation::copy(0x100, 0x50));
-    ops.push_back(bindiff::Operation::insert({1, 2, 3}));
+    ops.push_back(bindiff::Operation::insert(literal, 3));
     ops.push_back(bindiff::Operation::copy(0x200, 0x30));
     
     std::vector<uint8_t> buffer;
@@ -118,6 +147,387 @@ TEST(operations_serialize_all) {
     return true;
 }
 
+TEST(operations_serialize_v2) {
+    const uint8_t literal[] = {1, 2, 3};
+    std::vector<bindiff::Operation> ops;
+    ops.push_back(bindiff::Operation::copy(0x10000, 0x50));
+    ops.push_back(bindiff::Operation::insert(literal, 3));
+    ops.push_back(bindiff::Operation::copy(0x10050, 0x30));    // 紧接上一个 COPY
+    ops.push_back(bindiff::Operation::copy(0x40, 200));        // 向后跳
+    ops.push_back(bindiff::Operation::copy_new(0x50, 0x20));
+    
+    std::vector<uint8_t> buffer;
+    bindiff::OperationSerializer::serialize_all(ops, buffer, bindiff::OP_FORMAT_V2);
+    
+    // (1+3+1) + (1+1+3) + (1+1+1) + (1+3+2) + (1+2+1) = 23 bytes，v1 为 13 + 8 + 13 + 13 + 9 = 56
+    ASSERT(buffer.size() == 23);
+    ASSERT(buffer[11] == 0 && buffer[12] == 0x30);   // 差值 0
+    
+    bindiff::OperationContext context;
+    size_t pos = 0;
+    for (const auto& expected : ops) {
+        bindiff::Operation parsed;
+        size_t read = bindiff::OperationSerializer::deserialize(buffer.data() + pos, buffer.size() - pos,
+                                                                parsed, context);
+        ASSERT(read > 0);
+        pos += read;
+        ASSERT(parsed.opcode == expected.opcode);
+        ASSERT(parsed.copy_offset == expected.copy_offset && parsed.copy_length == expected.copy_length);
+        ASSERT(op_data(parsed) == op_data(expected));
+    }
+    ASSERT(pos == buffer.size());
+    ASSERT(context.output_position == 0x50 + 3 + 0x30 + 200 + 0x20);
+    
+    // 截断的变长整数与超出已输出部分的 COPY_NEW 都拒绝
+    bindiff::OperationContext fresh;
+    bindiff::Operation parsed;
+    ASSERT(bindiff::OperationSerializer::deserialize(buffer.data(), 2, parsed, fresh) == 0);
+    std::vector<uint8_t> bad = {0x03, 0x10, 0x04};
+    ASSERT(bindiff::OperationSerializer::deserialize(bad.data(), bad.size(), parsed, fresh) == 0);
+    
+    // v1 编码的块仍可重建
+    std::vector<uint8_t> old_data(4096);
+    for (size_t i = 0; i < old_data.size(); ++i) old_data[i] = static_cast<uint8_t>(i * 7);
+    std::vector<bindiff::Operation> v1_ops;
+    v1_ops.push_back(bindiff::Operation::copy(1000, 500));
+    const uint8_t nines[] = {9, 9, 9};
+    v1_ops.push_back(bindiff::Operation::insert(nines, 3));
+    std::vector<uint8_t> v1_buffer;
+    bindiff::OperationSerializer::serialize_all(v1_ops, v1_buffer, bindiff::OP_FORMAT_V1);
+    ASSERT(v1_buffer.size() == 13 + 8);
+    
+    bindiff::LZ4Compressor compressor(1);
+    auto compressed = compressor.compress(v1_buffer.data(), v1_buffer.size());
+    bindiff::BlockProcessor processor(64 * 1024);
+    std::vector<uint8_t> output(503);
+    ASSERT(processor.reconstruct_block(0, old_data.data(), old_data.size(), compressed,
+                                       static_cast<uint32_t>(v1_buffer.size()), output.data(), output.size(),
+                                       nullptr, bindiff::OP_FORMAT_V1));
+    ASSERT(std::memcmp(output.data(), old_data.data() + 1000, 500) == 0);
+    ASSERT(output[500] == 9 && output[502] == 9);
+    
+    return true;
+}
+
+TEST(operations_split_streams) {
+    uint8_t old_bytes[4] = {1, 2, 3, 4};
+    uint8_t new_bytes[4] = {1, 2, 7, 4};
+    uint8_t diff[4];
+    bindiff::Operation::compute_diff(old_bytes, new_bytes, 4, diff);
+    const uint8_t head[] = {0xA1, 0xA2};
+    const uint8_t tail[] = {0xB1};
+    std::vector<bindiff::Operation> ops;
+    ops.push_back(bindiff::Operation::insert(head, 2));
+    ops.push_back(bindiff::Operation::copy(0, 2));
+    ops.push_back(bindiff::Operation::add(0, diff, 4));
+    ops.push_back(bindiff::Operation::insert(tail, 1));
+    
+    // 字段与 v2 相同，数据按顺序分入 literals / diffs
+    bindiff::OperationStreams streams;
+    bindiff::OperationSerializer::serialize_all(ops, streams);
+    std::vector<uint8_t> v2;
+    bindiff::OperationSerializer::serialize_all(ops, v2, bindiff::OP_FORMAT_V2);
+    ASSERT(streams.literals == std::vector<uint8_t>({0xA1, 0xA2, 0xB1}));
+    ASSERT(streams.diffs == std::vector<uint8_t>({0, 0, 4, 0}));
+    ASSERT(streams.control.size() + streams.literals.size() + streams.diffs.size() == v2.size());
+    
+    bindiff::OperationContext context;
+    bindiff::StreamCursor literals{streams.literals.data(), streams.literals.size(), 0};
+    bindiff::StreamCursor diffs{streams.diffs.data(), streams.diffs.size(), 0};
+    size_t pos = 0;
+    for (const auto& expected : ops) {
+        bindiff::Operation parsed;
+        size_t read = bindiff::OperationSerializer::deserialize(streams.control.data() + pos,
+                                                                streams.control.size() - pos,
+                                                                parsed, context, literals, diffs);
+        ASSERT(read > 0);
+        pos += read;
+        ASSERT(parsed.opcode == expected.opcode);
+        ASSERT(op_data(parsed) == op_data(expected));
+    }
+    ASSERT(pos == streams.control.size() && literals.exhausted() && diffs.exhausted());
+    
+    // 重建: 原样存储的流直接使用；流头声明的大小超出块数据时拒绝
+    std::vector<uint8_t> old_data(old_bytes, old_bytes + 4);
+    auto block = raw_block(ops);
+    bindiff::BlockProcessor processor(64 * 1024);
+    std::vector<uint8_t> output(9);
+    ASSERT(processor.reconstruct_block(0, old_data.data(), old_data.size(), block, 0, output.data(), output.size()));
+    ASSERT(output == std::vector<uint8_t>({0xA1, 0xA2, 1, 2, 1, 2, 7, 4, 0xB1}));
+    block.pop_back();
+    ASSERT(!processor.reconstruct_block(0, old_data.data(), old_data.size(), block, 0, output.data(), output.size()));
+    
+    return true;
+}
+
+TEST(operations_lazy_matching) {
+    // 旧数据: a 处为 s0..s39 后接无关字节，b 处为 s1..s39 后接 T
+    // 新数据: 前缀 + s0..s39 + T。贪心在 s0 处接受 40 字节的匹配，惰性匹配改为从 s1 开始一次覆盖到 T 末尾
+    uint32_t seed = 7;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>(seed >> 16);
+    };
+    std::vector<uint8_t> s(40), t(1000), prefix(100);
+    for (auto& b : s) b = next();
+    for (auto& b : t) b = next();
+    for (auto& b : prefix) b = next();
+    
+    std::vector<uint8_t> old_data(4096);
+    for (auto& b : old_data) b = next();
+    std::memcpy(old_data.data() + 500, s.data(), 40);
+    old_data[540] = static_cast<uint8_t>(t[0] ^ 0xFF);
+    old_data[1999] = static_cast<uint8_t>(s[0] ^ 0xFF);
+    std::memcpy(old_data.data() + 2000, s.data() + 1, 39);
+    std::memcpy(old_data.data() + 2039, t.data(), t.size());
+    
+    std::vector<uint8_t> new_data(prefix);
+    new_data.insert(new_data.end(), s.begin(), s.end());
+    new_data.insert(new_data.end(), t.begin(), t.end());
+    
+    bindiff::BlockProcessor greedy(64 * 1024);
+    bindiff::BlockProcessor lazy(64 * 1024, 1, 4);
+    auto greedy_result = greedy.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    auto lazy_result = lazy.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    ASSERT(greedy_result.success && lazy_result.success);
+    
+    // 贪心: INSERT(100) + COPY(500, 40) + COPY(2039, 1000); 惰性: INSERT(101) + COPY(2000, 1039)
+    // v2: 操作码 + 变长偏移差值 + 变长长度
+    ASSERT(greedy_result.original_size == (1 + 1 + 100) + (1 + 2 + 1) + (1 + 2 + 2));
+    ASSERT(lazy_result.original_size == (1 + 1 + 101) + (1 + 2 + 2));
+    
+    std::vector<uint8_t> output(new_data.size());
+    ASSERT(lazy.reconstruct_block(0, old_data.data(), old_data.size(), lazy_result.data,
+                                  lazy_result.original_size, output.data(), output.size()));
+    ASSERT(output == new_data);
+    
+    return true;
+}
+
+TEST(operations_fill) {
+    auto op = bindiff::Operation::fill(0xAB, 100000);
+    std::vector<uint8_t> serialized;
+    bindiff::OperationSerializer::serialize(op, serialized);
+    ASSERT(serialized.size() == op.serialized_size());
+    
+    bindiff::Operation decoded;
+    ASSERT(bindiff::OperationSerializer::deserialize(serialized.data(), serialized.size(), decoded) == 6);
+    ASSERT(decoded.opcode == bindiff::OpCode::FILL);
+    ASSERT(decoded.fill_value == 0xAB && decoded.fill_length == 100000);
+    
+    // 新数据: 随机 + 100000 个零 + 随机，零在旧数据中不存在，编码为 INSERT + FILL + INSERT
+    uint32_t seed = 3;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>((seed >> 16) | 1);
+    };
+    std::vector<uint8_t> old_data(4096);
+    for (auto& b : old_data) b = next();
+    std::vector<uint8_t> new_data(100200, 0);
+    for (size_t i = 0; i < 100; ++i) {
+        new_data[i] = next();
+        new_data[100100 + i] = next();
+    }
+    
+    bindiff::BlockProcessor processor(256 * 1024);
+    auto result = processor.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    ASSERT(result.success);
+    ASSERT(result.original_size == (1 + 1 + 100) + (1 + 1 + 3) + (1 + 1 + 100));
+    
+    std::vector<uint8_t> output(new_data.size(), 0xFF);
+    std::vector<bindiff::ByteRange> zero_fills;
+    ASSERT(processor.reconstruct_block(0, old_data.data(), old_data.size(), result.data, result.original_size,
+                                       output.data(), output.size(), &zero_fills));
+    ASSERT(output == new_data);
+    ASSERT(zero_fills.size() == 1);
+    ASSERT(zero_fills[0].offset == 100 && zero_fills[0].length == 100000);
+    
+    return true;
+}
+
+TEST(operations_self_copy) {
+    // 新数据: 前缀 + A + 旧数据片段 + A，A 在旧数据中不存在，第二份由 COPY_NEW 引用第一份
+    uint32_t seed = 5;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>(seed >> 16);
+    };
+    std::vector<uint8_t> old_data(8192), asset(3000), prefix(50);
+    for (auto& b : old_data) b = next();
+    for (auto& b : asset) b = next();
+    for (auto& b : prefix) b = next();
+    
+    std::vector<uint8_t> new_data(prefix);
+    new_data.insert(new_data.end(), asset.begin(), asset.end());
+    new_data.insert(new_data.end(), old_data.begin() + 1000, old_data.begin() + 5000);
+    new_data.insert(new_data.end(), asset.begin(), asset.end());
+    
+    bindiff::BlockProcessor plain(64 * 1024);
+    bindiff::BlockProcessor self(64 * 1024, 1, 0, true);
+    auto plain_result = plain.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    auto self_result = self.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    ASSERT(plain_result.success && self_result.success);
+    
+    // INSERT(3050) + COPY(4000) + INSERT(3000) -> INSERT(3050) + COPY(4000) + COPY_NEW(3000)
+    ASSERT(plain_result.original_size == (1 + 2 + 3050) + (1 + 2 + 2) + (1 + 2 + 3000));
+    ASSERT(self_result.original_size == (1 + 2 + 3050) + (1 + 2 + 2) + (1 + 2 + 2));
+    
+    std::vector<uint8_t> output(new_data.size());
+    ASSERT(self.reconstruct_block(0, old_data.data(), old_data.size(), self_result.data,
+                                  self_result.original_size, output.data(), output.size()));
+    ASSERT(output == new_data);
+    
+    // 来源不在已重建部分之前时拒绝
+    auto bad = raw_block({bindiff::Operation::copy_new(0, 16)});
+    ASSERT(!self.reconstruct_block(0, old_data.data(), old_data.size(), bad, static_cast<uint32_t>(bad.size()),
+                                   output.data(), 16));
+    
+    return true;
+}
+
+TEST(operations_self_copy_min_match) {
+    // COPY_NEW 的长度下限跟随匹配器的 min_match: 31 字节的块内重复在 min_match 24 时引用，32 时原样插入
+    uint32_t seed = 19;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>(seed >> 16);
+    };
+    std::vector<uint8_t> old_data(8192), repeat(31), gap(50);
+    for (auto& b : old_data) b = next();
+    for (auto& b : repeat) b = next();
+    
+    std::vector<uint8_t> new_data;
+    for (int k = 0; k < 2; ++k) {
+        for (auto& b : gap) b = next();
+        new_data.insert(new_data.end(), gap.begin(), gap.end());
+        new_data.insert(new_data.end(), repeat.begin(), repeat.end());
+    }
+    
+    bindiff::BlockMatcher fine(24), coarse(32);
+    fine.build_index(old_data.data(), old_data.size(), 24);
+    coarse.build_index(old_data.data(), old_data.size(), 32);
+    bindiff::BlockProcessor self(64 * 1024, 1, 0, true);
+    auto fine_result = self.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size(), &fine);
+    auto coarse_result = self.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size(), &coarse);
+    ASSERT(fine_result.success && coarse_result.success);
+    
+    // INSERT(162) -> INSERT(131) + COPY_NEW(50, 31)
+    ASSERT(coarse_result.original_size == (1 + 2 + 162));
+    ASSERT(fine_result.original_size == (1 + 2 + 131) + (1 + 1 + 1));
+    
+    std::vector<uint8_t> output(new_data.size());
+    ASSERT(self.reconstruct_block(0, old_data.data(), old_data.size(), fine_result.data,
+                                  fine_result.original_size, output.data(), output.size()));
+    ASSERT(output == new_data);
+    
+    return true;
+}
+
+TEST(operations_self_copy_roundtrip) {
+    // 新数据: 随机前缀 + 重复多次的随机串 + 随机后缀，重复串从未对齐的位置开始。
+    // 周期性数据上 COPY_NEW 反向扩展后来源不能越过当前位置，生成的补丁须能实际应用
+    uint32_t seed = 11;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>(seed >> 16);
+    };
+    std::vector<uint8_t> old_data(1024 * 1024);
+    for (auto& b : old_data) b = next();
+    
+    std::string old_path = "/tmp/bindiff_test_self_old.bin";
+    std::string new_path = "/tmp/bindiff_test_self_new.bin";
+    std::string patch_path = "/tmp/bindiff_test_self.bdp";
+    std::string out_path = "/tmp/bindiff_test_self_out.bin";
+    auto write = [](const std::string& path, const std::vector<uint8_t>& data) {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+        fclose(f);
+        return ok;
+    };
+    ASSERT(write(old_path, old_data));
+    
+    const size_t cases[][2] = {{1003, 100}, {999, 37}, {1001, 64}, {5, 250}};
+    for (const auto& c : cases) {
+        std::vector<uint8_t> new_data(c[0]), unit(c[1]), suffix(5000);
+        for (auto& b : new_data) b = next();
+        for (auto& b : unit) b = next();
+        for (auto& b : suffix) b = next();
+        for (int k = 0; k < 10; ++k) {
+            new_data.insert(new_data.end(), unit.begin(), unit.end());
+        }
+        new_data.insert(new_data.end(), suffix.begin(), suffix.end());
+        ASSERT(write(new_path, new_data));
+        
+        bindiff::DiffEngine diff;
+        ASSERT(diff.create_diff(old_path, new_path, patch_path).success);
+        bindiff::PatchEngine patch;
+        ASSERT(patch.apply_patch(old_path, patch_path, out_path).success);
+        
+        FILE* f = fopen(out_path.c_str(), "rb");
+        ASSERT(f);
+        std::vector<uint8_t> output(new_data.size() + 1);
+        size_t read = fread(output.data(), 1, output.size(), f);
+        fclose(f);
+        output.resize(read);
+        ASSERT(output == new_data);
+    }
+    
+    for (const auto* path : {&old_path, &new_path, &patch_path, &out_path}) {
+        bindiff::delete_file(*path);
+    }
+    return true;
+}
+
+TEST(operations_delta_add) {
+    uint8_t old_bytes[4] = {10, 20, 30, 250};
+    uint8_t new_bytes[4] = {10, 25, 30, 4};
+    uint8_t diff[4];
+    bindiff::Operation::compute_diff(old_bytes, new_bytes, 4, diff);
+    auto op = bindiff::Operation::add(7, diff, 4);
+    std::vector<uint8_t> serialized;
+    bindiff::OperationSerializer::serialize(op, serialized);
+    ASSERT(serialized.size() == op.serialized_size() && serialized.size() == 13 + 4);
+    
+    bindiff::Operation decoded;
+    ASSERT(bindiff::OperationSerializer::deserialize(serialized.data(), serialized.size(), decoded) == 17);
+    ASSERT(decoded.opcode == bindiff::OpCode::ADD);
+    ASSERT(decoded.copy_offset == 7 && decoded.copy_length == 4);
+    ASSERT(op_data(decoded) == std::vector<uint8_t>({0, 5, 0, 10}));
+    ASSERT(bindiff::OperationSerializer::deserialize(serialized.data(), serialized.size() - 1, decoded) == 0);
+    
+    // 新数据: 旧数据 [1000, 5000) 中从 500 到 3440 每隔 60 字节改动 1 个字节
+    // 编码为 COPY(1000, 500) + ADD(1500, 2940) + INSERT(1) + COPY(4441, 559)，最后一段相同部分够长，留给 COPY
+    uint32_t seed = 9;
+    auto next = [&]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint8_t>(seed >> 16);
+    };
+    std::vector<uint8_t> old_data(8192);
+    for (auto& b : old_data) b = next();
+    std::vector<uint8_t> new_data(old_data.begin() + 1000, old_data.begin() + 5000);
+    for (size_t pos = 500; pos <= 3440; pos += 60) {
+        new_data[pos] ^= 0x5A;
+    }
+    
+    bindiff::BlockProcessor processor(64 * 1024, 1, 0, false, true);
+    auto result = processor.process_block(0, old_data.data(), old_data.size(), new_data.data(), new_data.size());
+    ASSERT(result.success);
+    ASSERT(result.original_size == (1 + 2 + 2) + (1 + 1 + 2 + 2940) + (1 + 1 + 1) + (1 + 1 + 2));
+    
+    std::vector<uint8_t> output(new_data.size());
+    ASSERT(processor.reconstruct_block(0, old_data.data(), old_data.size(), result.data, result.original_size,
+                                       output.data(), output.size()));
+    ASSERT(output == new_data);
+    
+    // 超出旧数据范围时拒绝
+    auto bad = raw_block({bindiff::Operation::add(8190, diff, 4)});
+    ASSERT(!processor.reconstruct_block(0, old_data.data(), old_data.size(), bad, static_cast<uint32_t>(bad.size()),
+                                        output.data(), 4));
+    
+    return true;
+}
+
 void register_operations_tests() {
     // 已通过 TEST 宏自动注册
 }